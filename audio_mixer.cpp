@@ -0,0 +1,119 @@
+#include "audio_mixer.h"
+
+#include <cmath>
+#include <cstring>
+#include "trace.h"
+
+AudioMixer::AudioMixer() : device(0), rate(0), dropped(0) {
+    memset(voices, 0, sizeof(voices));
+    for (int i = 0; i <= WAVETABLE_SIZE; ++i) {
+        wavetable[i] = (Sint16)lrint(32767.0 * sin(2.0 * M_PI * i / WAVETABLE_SIZE));
+    }
+}
+
+AudioMixer::~AudioMixer() {
+    close();
+}
+
+bool AudioMixer::open(int sample_rate) {
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = sample_rate;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 512;  // Short buffers keep the collect beep responsive
+    want.callback = callback;
+    want.userdata = this;
+
+    device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if (device == 0) {
+        return false;
+    }
+    rate = have.freq;
+
+    // The device runs for the whole game and plays silence between sounds
+    SDL_PauseAudioDevice(device, 0);
+    return true;
+}
+
+void AudioMixer::close() {
+    if (device != 0) {
+        SDL_CloseAudioDevice(device);
+        device = 0;
+    }
+}
+
+void AudioMixer::play(const SoundEvent& sound) {
+    if (device == 0) {
+        return;
+    }
+    if (!pending.push(sound)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AudioMixer::callback(void* userdata, Uint8* stream, int len) {
+    TRACE_THREAD("audio");
+    TRACE_ZONE("mix_audio");
+    AudioMixer* mixer = (AudioMixer*)userdata;
+    mixer->startPending();
+    mixer->mix((Sint16*)stream, len / (int)sizeof(Sint16));
+}
+
+// Move queued sounds onto free voices (audio thread)
+void AudioMixer::startPending() {
+    SoundEvent sounds[8];
+    size_t count;
+    while ((count = pending.popBatch(sounds, 8)) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            Voice* voice = nullptr;
+            for (int v = 0; v < MAX_VOICES && !voice; ++v) {
+                if (voices[v].remaining <= 0) {
+                    voice = &voices[v];
+                }
+            }
+            if (!voice) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            voice->phase = 0;
+            voice->step = (Uint32)(sounds[i].frequency / rate * 4294967296.0);
+            voice->length = voice->remaining = sounds[i].duration_ms * rate / 1000;
+            voice->volume = sounds[i].volume;
+        }
+    }
+}
+
+void AudioMixer::mix(Sint16* out, int samples) {
+    const int FRACTION_BITS = 32 - WAVETABLE_BITS;
+    const Uint32 FRACTION_MASK = (1u << FRACTION_BITS) - 1;
+
+    for (int i = 0; i < samples; ++i) {
+        int sum = 0;
+        for (int v = 0; v < MAX_VOICES; ++v) {
+            Voice& voice = voices[v];
+            if (voice.remaining <= 0) {
+                continue;
+            }
+
+            // Linear interpolation between neighbouring table entries
+            Uint32 index = voice.phase >> FRACTION_BITS;
+            int frac = (int)((voice.phase & FRACTION_MASK) >> (FRACTION_BITS - 15));
+            int a = wavetable[index];
+            int b = wavetable[index + 1];
+            int sample = a + (((b - a) * frac) >> 15);
+
+            // Ramp the volume in and out over FADE_SAMPLES
+            int played = voice.length - voice.remaining;
+            int ramp = voice.remaining < played ? voice.remaining : played;
+            int volume = ramp < FADE_SAMPLES ? voice.volume * ramp / FADE_SAMPLES : voice.volume;
+
+            sum += (sample * volume) >> 15;
+            voice.phase += voice.step;
+            voice.remaining--;
+        }
+        if (sum > 32767) sum = 32767;
+        if (sum < -32768) sum = -32768;
+        out[i] = (Sint16)sum;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <atomic>
+#include "/opt/homebrew/Cellar/sdl2/2.30.9/include/SDL2/SDL.h"
+#include "message_queue.h"
+
+// A tone to play: a sine at frequency Hz for duration_ms, scaled by volume
+// (0..32767)
+struct SoundEvent {
+    float frequency;
+    int duration_ms;
+    int volume;
+};
+
+// Non-blocking software mixer.
+//
+// The game thread fires sounds with play(), which only pushes onto a
+// lock-free queue. The audio callback picks them up, assigns each one a
+// voice and mixes all active voices from a precomputed sine wavetable, so
+// overlapping sounds play together and nothing is computed with sin() on
+// the audio thread.
+class AudioMixer {
+public:
+    AudioMixer();
+    ~AudioMixer();
+
+    // Open the default output device and start the callback
+    bool open(int sample_rate);
+    void close();
+    bool isOpen() const { return device != 0; }
+
+    // Queue a sound. Never blocks; drops the sound if the queue is full or
+    // no device is open. Must only be called from one thread at a time.
+    void play(const SoundEvent& sound);
+
+    // Sounds dropped because the queue or every voice was busy
+    size_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    static const int WAVETABLE_BITS = 10;
+    static const int WAVETABLE_SIZE = 1 << WAVETABLE_BITS;
+    static const int MAX_VOICES = 16;
+    static const int FADE_SAMPLES = 256;  // Attack/release ramp, avoids clicks
+
+    struct Voice {
+        Uint32 phase;      // Position in the wavetable, 32-bit fixed point
+        Uint32 step;       // Phase increment per sample
+        int remaining;     // Samples left to play
+        int length;        // Total samples
+        int volume;
+    };
+
+    static void callback(void* userdata, Uint8* stream, int len);
+    void startPending();
+    void mix(Sint16* out, int samples);
+
+    SDL_AudioDeviceID device;
+    int rate;
+    SpscQueue<SoundEvent, 64> pending;
+    Voice voices[MAX_VOICES];
+    Sint16 wavetable[WAVETABLE_SIZE + 1];  // One sine cycle plus a guard sample for interpolation
+    std::atomic<size_t> dropped;
+};
+
+#endif // AUDIO_MIXER_H
@@ -0,0 +1,824 @@
+// Benchmarks for the game's hot paths. Results are written as JSON so runs
+// from different commits can be compared:
+//
+//   make bench BENCH_ARGS="--sizes 32,256 --players 2,64 --out bench.json"
+//
+// Every case is calibrated to run for at least --min-time ms, then timed
+// --repeats times; min, median and max nanoseconds per operation are
+// reported. Rendering uses SDL's software renderer on the dummy video
+// driver, so no display is needed.
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include "/opt/homebrew/Cellar/sdl2/2.30.9/include/SDL2/SDL.h"
+#include "message_queue.h"
+#include "simd_kernels.h"
+#include "metrics.h"
+#include "game_board.h"
+#include "snapshot.h"
+#include "rollback.h"
+#include "timer_wheel.h"
+#include "render.h"
+#include "term_render.h"
+#include "soft_render.h"
+#include "frame_export.h"
+#include "bot_engine.h"
+#include "move_resolver.h"
+#include "thread_pool.h"
+#include "log.h"
+#include "trace.h"
+
+using namespace std;
+
+struct BenchOptions {
+    vector<int> sizes;
+    vector<int> players;
+    vector<double> densities;  // Items per cell for move_player
+    int producers;             // Producer threads for message_transport
+    int threads;               // Worker threads for resolve_moves and board_construction
+    int min_time_ms;
+    int repeats;
+    uint32_t seed;
+    string filter;             // Only run benchmarks whose name contains this
+    string out_path;           // JSON goes to stdout if empty
+
+    BenchOptions() : sizes({16, 64, 256}), players({2, 64}), densities({0.01, 0.1, 1.0}),
+                     producers(max(1, min(4, (int)thread::hardware_concurrency() - 1))),
+                     threads(max(1, (int)thread::hardware_concurrency())),
+                     min_time_ms(100), repeats(5), seed(1) {}
+};
+
+struct BenchResult {
+    string name;
+    vector<pair<string, double> > params;
+    uint64_t ops;                // Operations per timed run
+    vector<double> ns_per_op;    // One per repeat
+    vector<pair<string, double> > extra;
+};
+
+// Runs ops operations and returns the nanoseconds spent in the timed part
+typedef function<uint64_t(uint64_t ops)> BenchBody;
+
+BenchOptions opts;
+vector<BenchResult> results;
+
+bool selected(const string& name) {
+    return opts.filter.empty() || name.find(opts.filter) != string::npos;
+}
+
+// Grow the operation count until one run takes min_time_ms, then time
+// opts.repeats runs of that size
+BenchResult runBench(const string& name, const vector<pair<string, double> >& params, BenchBody body) {
+    BenchResult result;
+    result.name = name;
+    result.params = params;
+
+    const uint64_t min_ns = (uint64_t)opts.min_time_ms * 1000000;
+    uint64_t ops = 1;
+    for (;;) {
+        uint64_t ns = max<uint64_t>(body(ops), 1);
+        if (ns >= min_ns) {
+            break;
+        }
+        // Aim a bit past the target, growing at most 10x per step
+        uint64_t next = (uint64_t)((double)ops * min_ns * 1.2 / ns);
+        ops = max(ops + 1, min(next, ops * 10));
+    }
+    result.ops = ops;
+    for (int r = 0; r < opts.repeats; ++r) {
+        result.ns_per_op.push_back((double)body(ops) / ops);
+    }
+
+    vector<double> sorted = result.ns_per_op;
+    sort(sorted.begin(), sorted.end());
+    cerr << name;
+    for (const auto& p : params) {
+        cerr << " " << p.first << "=" << p.second;
+    }
+    cerr << ": " << sorted[sorted.size() / 2] << " ns/op\n";
+    return result;
+}
+
+// Constructing a board: players plus two items per row, big boards
+// filling their bands on --threads workers
+void benchBoardConstruction(int size, int players) {
+    uint32_t seed = opts.seed;
+    ThreadPool pool((size_t)opts.threads);
+    results.push_back(runBench("board_construction",
+        {{"board_size", size}, {"players", players}, {"threads", opts.threads}},
+        [size, players, &seed, &pool](uint64_t ops) {
+            uint64_t start = nowNs();
+            long sink = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                GameBoard board(seed++, size, players, -1, &pool);
+                sink += board.items_remaining;
+            }
+            uint64_t elapsed = nowNs() - start;
+            if (sink < 0) {
+                cerr << sink;
+            }
+            return elapsed;
+        }));
+}
+
+// Random walks through movePlayer with density items per cell. The board
+// is rebuilt (untimed) once half of its items are gone, so the density
+// stays roughly where it started.
+void benchMovePlayer(int size, int players, double density) {
+    int num_items = max(1, (int)(density * size * size));
+    uint32_t seed = opts.seed;
+    GameBoard board(seed, size, players, num_items);
+    game = &board;
+
+    // Pre-generated moves, so the benchmark doesn't time the generator
+    vector<pair<int, int> > moves(4096);
+    mt19937 gen(opts.seed);
+    for (auto& move : moves) {
+        uint32_t bits = gen();
+        move = make_pair((int)((bits >> 2) % players), (int)(bits & 3));
+    }
+
+    uint64_t total_moves = 0;
+    uint64_t collections = 0;
+    BenchResult result = runBench("move_player",
+        {{"board_size", size}, {"players", players}, {"density", density}},
+        [&](uint64_t ops) {
+            const uint64_t CHUNK = 1024;
+            uint64_t elapsed = 0;
+            size_t next = 0;
+            for (uint64_t done = 0; done < ops; ) {
+                uint64_t chunk = min(CHUNK, ops - done);
+                uint64_t start = nowNs();
+                for (uint64_t i = 0; i < chunk; ++i) {
+                    const pair<int, int>& move = moves[next];
+                    next = (next + 1) & (moves.size() - 1);
+                    if (movePlayer(board.players[move.first], DIR_DX[move.second], DIR_DY[move.second])) {
+                        collections++;
+                    }
+                }
+                elapsed += nowNs() - start;
+                done += chunk;
+                if (board.items_remaining * 2 < num_items) {
+                    board = GameBoard(++seed, size, players, num_items);
+                }
+            }
+            total_moves += ops;
+            return elapsed;
+        });
+    result.extra.push_back(make_pair("collections_per_move", (double)collections / total_moves));
+    results.push_back(result);
+    game = nullptr;
+}
+
+// One pass of the vectorized item scan: every player's cell tested against
+// every item, as collectUnderEach does for a step's collections
+void benchItemScan(int size, int players, double density) {
+    int num_items = max(1, (int)(density * size * size));
+    GameBoard board(opts.seed, size, players, num_items);
+    vector<uint32_t> xs, ys;
+    for (const auto& player : board.players) {
+        xs.push_back((uint32_t)player.x);
+        ys.push_back((uint32_t)player.y);
+    }
+    vector<uint64_t> hits;
+
+    BenchResult result = runBench("item_scan",
+        {{"board_size", size}, {"players", players}, {"density", density}},
+        [&](uint64_t ops) {
+            uint64_t start = nowNs();
+            for (uint64_t i = 0; i < ops; ++i) {
+                hits.assign(board.items.wordCount(), 0);
+                matchCells(board.items.xData(), board.items.yData(), board.items.size(),
+                           &xs[0], &ys[0], xs.size(), &hits[0]);
+            }
+            return nowNs() - start;
+        });
+    result.extra.push_back(make_pair("items", (double)board.items.size()));
+    results.push_back(result);
+}
+
+// Remaining-item count by popcount over the collected bitset, as a
+// rollback recounts it
+void benchCountRemaining(int size, double density) {
+    int num_items = max(1, (int)(density * size * size));
+    GameBoard board(opts.seed, size, 2, num_items);
+    BenchResult result = runBench("count_remaining", {{"board_size", size}, {"density", density}},
+        [&board](uint64_t ops) {
+            uint64_t start = nowNs();
+            size_t sink = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                sink += board.items.countRemaining();
+            }
+            uint64_t elapsed = nowNs() - start;
+            if (sink == 0) {
+                cerr << "no items\n";
+            }
+            return elapsed;
+        });
+    result.extra.push_back(make_pair("items", (double)board.items.size()));
+    results.push_back(result);
+}
+
+void benchIsGameOver(int size) {
+    GameBoard board(opts.seed, size, 2);
+    game = &board;
+    results.push_back(runBench("is_game_over", {{"board_size", size}}, [](uint64_t ops) {
+        uint64_t start = nowNs();
+        uint64_t over = 0;
+        for (uint64_t i = 0; i < ops; ++i) {
+            over += isGameOver();
+        }
+        uint64_t elapsed = nowNs() - start;
+        if (over != 0) {
+            cerr << "board unexpectedly over\n";
+        }
+        return elapsed;
+    }));
+    game = nullptr;
+}
+
+// The input path of the interactive game: producer threads post moves
+// into a FanInQueue, and one consumer drains and applies them. Each
+// producer owns a lane and sends for players p, p + producers, ...
+void benchMessageTransport(int size, int players) {
+    typedef FanInQueue<GameMessage, 1024> Queue;
+    int producers = min(opts.producers, players);
+    LatencyHistogram latency;
+    uint64_t retries = 0;
+
+    BenchResult result = runBench("message_transport",
+        {{"board_size", size}, {"players", players}, {"producers", producers}},
+        [&](uint64_t ops) {
+            GameBoard board(opts.seed, size, players);
+            game = &board;
+            Queue queue(producers);
+            atomic<bool> go(false);
+
+            vector<thread> threads;
+            for (int p = 0; p < producers; ++p) {
+                uint64_t count = ops / producers + ((uint64_t)p < ops % producers ? 1 : 0);
+                threads.push_back(thread([&queue, &go, p, count, players, producers]() {
+                    minstd_rand rng(p + 1);
+                    int player = p;
+                    while (!go.load(memory_order_acquire)) {
+                    }
+                    for (uint64_t i = 0; i < count; ++i) {
+                        GameMessage msg = makeMove(player, rng() % 4);
+                        while (!queue.post(p, msg)) {
+                            this_thread::yield();  // Lane full; the consumer is behind
+                        }
+                        player += producers;
+                        if (player >= players) {
+                            player = p;
+                        }
+                    }
+                }));
+            }
+
+            uint64_t start = nowNs();
+            go.store(true, memory_order_release);
+            uint64_t consumed = 0;
+            while (consumed < ops) {
+                size_t n = queue.drain([&latency](GameMessage& msg) {
+                    latency.record(nowNs() - msg.created_ns);
+                    applyMessage(msg);
+                });
+                consumed += n;
+                if (n == 0) {
+                    queue.wait(1);
+                }
+            }
+            uint64_t elapsed = nowNs() - start;
+            for (auto& t : threads) {
+                t.join();
+            }
+            retries += queue.droppedCount();
+            game = nullptr;
+            return elapsed;
+        });
+    result.extra.push_back(make_pair("queue_latency_p50_ns", (double)latency.percentile(50)));
+    result.extra.push_back(make_pair("queue_latency_p99_ns", (double)latency.percentile(99)));
+    result.extra.push_back(make_pair("full_lane_retries", (double)retries));
+    results.push_back(result);
+}
+
+bool initVideo() {
+    static int state = 0;  // 0 = not tried, 1 = ok, -1 = failed
+    if (state == 0) {
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");  // SDL_VIDEODRIVER still wins
+        state = -1;
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            cerr << "SDL initialization failed: " << SDL_GetError() << endl;
+        } else if (!(window = SDL_CreateWindow("bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                               SCREEN_SIZE, SCREEN_SIZE, SDL_WINDOW_HIDDEN))) {
+            cerr << "Window creation failed: " << SDL_GetError() << endl;
+        } else if (!(renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE))) {
+            cerr << "Renderer creation failed: " << SDL_GetError() << endl;
+        } else {
+            state = 1;
+        }
+        if (state < 0) {
+            cerr << "Skipping render benchmarks\n";
+        }
+    }
+    return state > 0;
+}
+
+// renderGame as the game drives it: each frame one player moves, the board
+// goes through a SnapshotBuffer and the frame is drawn from the caches.
+// With cold set the caches are dropped before every frame instead, which
+// is the cost of the first frame or one after a render device reset.
+void benchRenderGame(int size, int players, bool cold) {
+    if (!initVideo()) {
+        return;
+    }
+    uint32_t seed = opts.seed;
+    GameBoard board(seed, size, players);
+    game = &board;
+    SnapshotBuffer buffer;
+    GameSnapshot snapshot;
+    vector<InputStamp> inputs;
+    invalidateRenderCache();
+
+    results.push_back(runBench(cold ? "render_game_cold" : "render_game",
+        {{"board_size", size}, {"players", players}},
+        [&](uint64_t ops) {
+            uint64_t elapsed = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                int player = (int)(i % players);
+                int dir = (int)((i / players) % 4);
+                movePlayer(board.players[player], DIR_DX[dir], DIR_DY[dir]);
+                if (board.items_remaining == 0) {
+                    board = GameBoard(++seed, size, players);
+                }
+                uint64_t start = nowNs();
+                buffer.publish(board, inputs);
+                buffer.acquire(snapshot);
+                if (cold) {
+                    invalidateRenderCache();
+                    renderCache.itemRectsVersion = 0;
+                } else {
+                    renderCache.dirty = true;  // Draw even if the move hit a wall
+                }
+                renderGame(snapshot, false);
+                elapsed += nowNs() - start;
+            }
+            return elapsed;
+        }));
+    game = nullptr;
+}
+
+// One bot tick on a single thread: sync the item grid, plan every
+// player as a bot and apply the moves. Reported per bot.
+void benchBotPlanning(int size, int players) {
+    uint32_t seed = opts.seed;
+    vector<int> ids(players);
+    for (int i = 0; i < players; ++i) {
+        ids[i] = i;
+    }
+    unique_ptr<GameBoard> board(new GameBoard(seed, size, players));
+    unique_ptr<BotEngine> engine(new BotEngine(*board, ids));
+    game = board.get();
+    MoveResolver resolver;
+    uint64_t replans = 0;
+    uint64_t planned = 0;
+    BenchResult result = runBench("bot_planning",
+        {{"board_size", size}, {"players", players}},
+        [&](uint64_t ops) {
+            uint64_t elapsed = 0;
+            for (uint64_t done = 0; done < ops; done += players) {
+                if (board->items_remaining * 2 < (int)board->items.size()) {
+                    replans += engine->replans();
+                    board.reset(new GameBoard(++seed, size, players));
+                    engine.reset(new BotEngine(*board, ids));
+                    game = board.get();
+                }
+                uint64_t start = nowNs();
+                engine->sync(*board);
+                engine->plan(*board, 0, engine->size());
+                for (size_t i = 0; i < engine->size(); ++i) {
+                    int dir = engine->move(i);
+                    if (dir >= 0) {
+                        resolver.add((int)i, dir);
+                    }
+                }
+                resolver.resolve(*board);
+                elapsed += nowNs() - start;
+            }
+            planned += (ops + players - 1) / players * players;
+            // Per bot, rounding ops up to whole ticks
+            return elapsed * ops / ((ops + players - 1) / players * players);
+        });
+    replans += engine->replans();
+    result.extra.push_back(make_pair("replans_per_bot_tick", (double)replans / planned));
+    results.push_back(result);
+    game = nullptr;
+}
+
+// One tick's batch of moves, one random move per player, resolved by
+// priority over --threads workers
+void benchResolveMoves(int size, int players) {
+    uint32_t seed = opts.seed;
+    unique_ptr<GameBoard> board(new GameBoard(seed, size, players));
+    ThreadPool pool((size_t)opts.threads);
+    MoveResolver resolver;
+    mt19937 gen(seed);
+    uint64_t ticks = 0;
+    BenchResult result = runBench("resolve_moves",
+        {{"board_size", size}, {"players", players}, {"threads", opts.threads}},
+        [&](uint64_t ops) {
+            uint64_t elapsed = 0;
+            for (uint64_t done = 0; done < ops; done += players) {
+                if (board->items_remaining * 2 < (int)board->items.size()) {
+                    board.reset(new GameBoard(++seed, size, players));
+                }
+                for (int i = 0; i < players; ++i) {
+                    resolver.add(i, (int)(gen() & 3));
+                }
+                uint64_t start = nowNs();
+                resolver.resolve(*board, &pool);
+                elapsed += nowNs() - start;
+                ticks++;
+            }
+            return elapsed * ops / ((ops + players - 1) / players * players);
+        });
+    result.extra.push_back(make_pair("contested_per_tick", (double)resolver.contested() / ticks));
+    results.push_back(result);
+}
+
+// A tick that gets a move 8 ticks late: roll back, replay the 8 ticks and
+// run the new one, with a random move per player every tick. One op is
+// the whole advance, which has to fit in a frame.
+void benchRollback(int size, int players) {
+    const uint32_t LATE_TICKS = 8;
+    uint32_t seed = opts.seed;
+    unique_ptr<GameBoard> board;
+    unique_ptr<RollbackSimulation> sim;
+    mt19937 gen(seed);
+    auto reset = [&]() {
+        sim.reset();
+        board.reset(new GameBoard(seed++, size, players));
+        sim.reset(new RollbackSimulation(*board, 32));
+    };
+    reset();
+    results.push_back(runBench("rollback", {{"board_size", size}, {"players", players}},
+        [&](uint64_t ops) {
+            uint64_t elapsed = 0;
+            for (uint64_t i = 0; i < ops; ++i) {
+                if (board->items_remaining * 2 < (int)board->items.size()) {
+                    reset();
+                }
+                while (sim->tick() < LATE_TICKS) {
+                    sim->advance();
+                }
+                for (int p = 0; p < players; ++p) {
+                    sim->add(sim->tick(), p, (int)(gen() & 3));
+                }
+                sim->add(sim->tick() - LATE_TICKS, (int)(gen() % players), (int)(gen() & 3));
+                uint64_t start = nowNs();
+                sim->advance();
+                elapsed += nowNs() - start;
+            }
+            return elapsed;
+        }));
+}
+
+// Timers firing with pending timers waiting, about 16 due per tick. One
+// op is a timer firing and being scheduled again; the cost per op should
+// stay flat however many are pending. Scheduling and cancelling a timer
+// is timed on the side.
+void benchTimerWheel(size_t pending) {
+    const uint32_t span = (uint32_t)max<size_t>(64, pending / 16);
+    TimerWheel wheel;
+    mt19937 gen(opts.seed);
+    for (size_t i = 0; i < pending; ++i) {
+        wheel.schedule(gen() % span, 0, 0);
+    }
+    vector<Timer> due;
+    uint32_t tick = 0;
+    BenchResult result = runBench("timer_wheel", {{"pending", (double)pending}}, [&](uint64_t ops) {
+        uint64_t fired = 0;
+        uint64_t start = nowNs();
+        while (fired < ops) {
+            due.clear();
+            wheel.expire(tick, due);
+            for (size_t i = 0; i < due.size(); ++i) {
+                wheel.schedule(tick + 1 + gen() % span, 0, 0);
+            }
+            fired += due.size();
+            tick++;
+        }
+        return (nowNs() - start) * ops / fired;
+    });
+
+    vector<TimerId> ids(1 << 16);
+    uint64_t start = nowNs();
+    for (auto& id : ids) {
+        id = wheel.schedule(tick + gen() % span, 0, 0);
+    }
+    uint64_t scheduled = nowNs();
+    shuffle(ids.begin(), ids.end(), gen);
+    uint64_t shuffled = nowNs();
+    for (TimerId id : ids) {
+        wheel.cancel(id);
+    }
+    result.extra.push_back(make_pair("schedule_ns", (double)(scheduled - start) / ids.size()));
+    result.extra.push_back(make_pair("cancel_ns", (double)(nowNs() - shuffled) / ids.size()));
+    results.push_back(result);
+}
+
+// The terminal front end: each frame one player moves and the changed
+// cells are written to /dev/null, at the default 80x24 terminal size
+void benchRenderTerm(int size, int players) {
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+    uint32_t seed = opts.seed;
+    GameBoard board(seed, size, players);
+    game = &board;
+    SnapshotBuffer buffer;
+    GameSnapshot snapshot;
+    vector<InputStamp> inputs;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    {
+        TerminalRenderer term(fd);
+        BenchResult result = runBench("render_term",
+            {{"board_size", size}, {"players", players}},
+            [&](uint64_t ops) {
+                uint64_t elapsed = 0;
+                for (uint64_t i = 0; i < ops; ++i) {
+                    int player = (int)(i % players);
+                    int dir = (int)((i / players) % 4);
+                    movePlayer(board.players[player], DIR_DX[dir], DIR_DY[dir]);
+                    if (board.items_remaining == 0) {
+                        board = GameBoard(++seed, size, players);
+                    }
+                    uint64_t start = nowNs();
+                    buffer.publish(board, inputs);
+                    buffer.acquire(snapshot);
+                    term.draw(snapshot, false);
+                    elapsed += nowNs() - start;
+                }
+                frames += ops;
+                bytes = term.bytesWritten();
+                return elapsed;
+            });
+        result.extra.push_back(make_pair("bytes_per_frame", (double)bytes / max<uint64_t>(1, frames)));
+        results.push_back(result);
+    }
+    close(fd);
+    game = nullptr;
+}
+
+// The software renderer drawing one frame on --threads workers, and
+// encoding it as a PNG
+void benchRenderSoft(int size, int players) {
+    uint32_t seed = opts.seed;
+    GameBoard board(seed, size, players);
+    game = &board;
+    SnapshotBuffer buffer;
+    GameSnapshot snapshot;
+    vector<InputStamp> inputs;
+    ThreadPool pool(opts.threads);
+    SoftwareRenderer painter;
+    uint64_t frames = 0;
+    uint64_t png_ns = 0;
+    uint64_t png_bytes = 0;
+    BenchResult result = runBench("render_soft",
+        {{"board_size", size}, {"players", players}, {"threads", (double)pool.size()}},
+        [&](uint64_t ops) {
+            uint64_t elapsed = 0;
+            vector<uint8_t> png;
+            for (uint64_t i = 0; i < ops; ++i) {
+                int player = (int)(i % players);
+                int dir = (int)((i / players) % 4);
+                movePlayer(board.players[player], DIR_DX[dir], DIR_DY[dir]);
+                if (board.items_remaining == 0) {
+                    board = GameBoard(++seed, size, players);
+                }
+                uint64_t start = nowNs();
+                buffer.publish(board, inputs);
+                buffer.acquire(snapshot);
+                painter.draw(snapshot, false, &pool);
+                uint64_t drawn = nowNs();
+                elapsed += drawn - start;
+                if (i % 16 == 0) {
+                    // Sampled, or encoding would dominate the run time
+                    encodePng(&painter.pixels()[0], painter.size(), painter.size(), png);
+                    png_ns += nowNs() - drawn;
+                    png_bytes += png.size();
+                    frames++;
+                }
+            }
+            return elapsed;
+        });
+    result.extra.push_back(make_pair("encode_png_ns", (double)png_ns / max<uint64_t>(1, frames)));
+    result.extra.push_back(make_pair("png_bytes", (double)png_bytes / max<uint64_t>(1, frames)));
+    results.push_back(result);
+    game = nullptr;
+}
+
+void writeJson(ostream& out) {
+    out << "{\n  \"simd\": \"" << simdKernelName() << "\""
+        << ",\n  \"seed\": " << opts.seed
+        << ",\n  \"min_time_ms\": " << opts.min_time_ms
+        << ",\n  \"repeats\": " << opts.repeats
+        << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        vector<double> sorted = r.ns_per_op;
+        sort(sorted.begin(), sorted.end());
+        double median = sorted[sorted.size() / 2];
+
+        out << "    {\"name\": \"" << r.name << "\", \"params\": {";
+        for (size_t p = 0; p < r.params.size(); ++p) {
+            out << (p ? ", " : "") << "\"" << r.params[p].first << "\": " << r.params[p].second;
+        }
+        out << "}, \"ops\": " << r.ops
+            << ", \"ns_per_op\": {\"min\": " << sorted.front()
+            << ", \"median\": " << median
+            << ", \"max\": " << sorted.back() << "}"
+            << ", \"ops_per_second\": " << (median > 0 ? 1e9 / median : 0);
+        for (const auto& e : r.extra) {
+            out << ", \"" << e.first << "\": " << e.second;
+        }
+        out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+template <typename T>
+bool parseList(const string& arg, vector<T>& out) {
+    out.clear();
+    stringstream in(arg);
+    string item;
+    while (getline(in, item, ',')) {
+        stringstream value(item);
+        T v;
+        if (!(value >> v) || v <= 0) {
+            return false;
+        }
+        out.push_back(v);
+    }
+    return !out.empty();
+}
+
+// What a log call costs the thread making it: packing the record and
+// pushing it on the thread's ring. The rings are flushed (untimed, to
+// /dev/null) before they can fill.
+void benchLogEvent() {
+    FILE* null_file = fopen("/dev/null", "w");
+    if (!null_file) {
+        return;
+    }
+    setLogFile(null_file);
+    setLogLevel(LOG_LEVEL_INFO);
+    results.push_back(runBench("log_event", {}, [](uint64_t ops) {
+        uint64_t elapsed = 0;
+        for (uint64_t done = 0; done < ops;) {
+            uint64_t n = min<uint64_t>(ops - done, 1024);
+            uint64_t start = nowNs();
+            for (uint64_t i = 0; i < n; ++i) {
+                LOG_INFO("Player {} collected an item! Score: {}", '1', done + i);
+            }
+            elapsed += nowNs() - start;
+            flushLog();
+            done += n;
+        }
+        return elapsed;
+    }));
+    setLogLevel(LOG_LEVEL_WARN);
+    setLogFile(nullptr);
+    fclose(null_file);
+}
+
+// One trace zone opened and closed while tracing is on
+void benchTraceZone() {
+    startTracing();
+    results.push_back(runBench("trace_zone", {}, [](uint64_t ops) {
+        uint64_t start = nowNs();
+        for (uint64_t i = 0; i < ops; ++i) {
+            TRACE_ZONE("bench");
+        }
+        return nowNs() - start;
+    }));
+    stopTracing();
+}
+
+void printUsage(const char* prog) {
+    cerr << "Usage: " << prog << " [options]\n"
+         << "  --sizes A,B,...     Board sizes (default 16,64,256)\n"
+         << "  --players A,B,...   Player counts (default 2,64)\n"
+         << "  --densities A,...   Items per cell for move_player, item_scan and\n"
+         << "                      count_remaining (default 0.01,0.1,1)\n"
+         << "  --producers N       Producer threads for message_transport (default up to 4)\n"
+         << "  --threads N         Worker threads for resolve_moves and board_construction\n"
+         << "                      (default one per core)\n"
+         << "  --min-time MS       Minimum duration of one timed run (default 100)\n"
+         << "  --repeats N         Timed runs per case (default 5)\n"
+         << "  --seed N            Seed for boards and moves (default 1)\n"
+         << "  --filter TEXT       Only run benchmarks whose name contains TEXT\n"
+         << "  --out FILE          Write JSON to FILE instead of stdout\n";
+}
+
+bool parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") {
+            if (!parseList(value, opts.sizes)) return false;
+        } else if (arg == "--players") {
+            if (!parseList(value, opts.players)) return false;
+        } else if (arg == "--densities") {
+            if (!parseList(value, opts.densities)) return false;
+        } else if (arg == "--producers") {
+            opts.producers = atoi(value.c_str());
+        } else if (arg == "--threads") {
+            opts.threads = atoi(value.c_str());
+        } else if (arg == "--min-time") {
+            opts.min_time_ms = atoi(value.c_str());
+        } else if (arg == "--repeats") {
+            opts.repeats = atoi(value.c_str());
+        } else if (arg == "--seed") {
+            opts.seed = (uint32_t)strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--filter") {
+            opts.filter = value;
+        } else if (arg == "--out") {
+            opts.out_path = value;
+        } else {
+            return false;
+        }
+    }
+    return opts.producers > 0 && opts.threads > 0 && opts.min_time_ms > 0 && opts.repeats > 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (!parseOptions(argc, argv)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    setLogLevel(LOG_LEVEL_WARN);
+
+    for (int size : opts.sizes) {
+        for (int players : opts.players) {
+            if (selected("board_construction")) benchBoardConstruction(size, players);
+            for (double density : opts.densities) {
+                if (selected("move_player")) benchMovePlayer(size, players, density);
+                if (selected("item_scan")) benchItemScan(size, players, density);
+            }
+            if (selected("message_transport")) benchMessageTransport(size, players);
+            if (selected("render_game")) benchRenderGame(size, players, false);
+            if (selected("render_game_cold")) benchRenderGame(size, players, true);
+            if (selected("render_term")) benchRenderTerm(size, players);
+            if (selected("render_soft")) benchRenderSoft(size, players);
+            if (selected("bot_planning")) benchBotPlanning(size, players);
+            if (selected("resolve_moves")) benchResolveMoves(size, players);
+            if (selected("rollback")) benchRollback(size, players);
+        }
+        if (selected("is_game_over")) benchIsGameOver(size);
+        for (double density : opts.densities) {
+            if (selected("count_remaining")) benchCountRemaining(size, density);
+        }
+    }
+    if (selected("timer_wheel")) {
+        for (size_t pending : {1000, 100000, 1000000, 10000000}) {
+            benchTimerWheel(pending);
+        }
+    }
+    if (selected("log_event")) benchLogEvent();
+    if (selected("trace_zone")) benchTraceZone();
+
+    if (opts.out_path.empty()) {
+        writeJson(cout);
+    } else {
+        ofstream out(opts.out_path.c_str());
+        writeJson(out);
+        if (!out) {
+            cerr << "Failed to write " << opts.out_path << endl;
+            return 1;
+        }
+    }
+
+    invalidateRenderCache();
+    if (renderer) SDL_DestroyRenderer(renderer);
+    if (window) SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "bot_engine.h"
+
+#include <climits>
+#include <cstdlib>
+
+using namespace std;
+
+ItemGrid::ItemGrid(const GameBoard& board) : shift(0) {
+    const ItemStore& store = board.items;
+    int size = board.board_size;
+
+    // Aim for about four items per bucket
+    double cells_per_bucket = store.size() > 0 ? 4.0 * size * size / store.size() : (double)size * size;
+    while ((double)(2 << shift) * (2 << shift) <= cells_per_bucket && (1 << shift) < size) {
+        shift++;
+    }
+    buckets_per_side = ((size - 1) >> shift) + 1;
+    size_t num_buckets = (size_t)buckets_per_side * buckets_per_side;
+
+    // Counting sort of the items by bucket
+    bucket_start.assign(num_buckets + 1, 0);
+    remaining.assign(num_buckets, 0);
+    for (size_t i = 0; i < store.size(); ++i) {
+        int b = bucketOf(store.x(i), store.y(i));
+        bucket_start[b + 1]++;
+        if (!store.isCollected(i)) {
+            remaining[b]++;
+        }
+    }
+    for (size_t b = 0; b < num_buckets; ++b) {
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    items.resize(store.size());
+    vector<int> fill(bucket_start.begin(), bucket_start.end() - 1);
+    for (size_t i = 0; i < store.size(); ++i) {
+        items[fill[bucketOf(store.x(i), store.y(i))]++] = (int)i;
+    }
+    seen.assign(store.collectedData(), store.collectedData() + store.wordCount());
+}
+
+void ItemGrid::sync(const GameBoard& board) {
+    const ItemStore& store = board.items;
+    const uint64_t* collected = store.collectedData();
+    for (size_t w = 0; w < seen.size(); ++w) {
+        // Items come back when the board is rolled back
+        uint64_t changed = collected[w] ^ seen[w];
+        if (!changed) {
+            continue;
+        }
+        seen[w] = collected[w];
+        for (; changed; changed &= changed - 1) {
+            int bit = __builtin_ctzll(changed);
+            size_t i = w * 64 + (size_t)bit;
+            remaining[bucketOf(store.x(i), store.y(i))] += (collected[w] >> bit) & 1 ? -1 : 1;
+        }
+    }
+}
+
+int ItemGrid::nearest(const GameBoard& board, int x, int y) const {
+    const ItemStore& store = board.items;
+    int bx = x >> shift;
+    int by = y >> shift;
+    int best = -1;
+    int best_dist = INT_MAX;
+
+    // Search rings of buckets outwards. Every cell in ring r is at least
+    // (r - 1) buckets plus one cell away, so once the best item is closer
+    // than that no further ring can beat it.
+    for (int r = 0; r < buckets_per_side; ++r) {
+        if (r > 0 && best_dist < ((r - 1) << shift) + 1) {
+            break;
+        }
+        for (int cy = by - r; cy <= by + r; ++cy) {
+            if (cy < 0 || cy >= buckets_per_side) {
+                continue;
+            }
+            // Whole rows at the top and bottom of the ring, just the two
+            // ends in between
+            bool edge = cy == by - r || cy == by + r;
+            int step = edge || r == 0 ? 1 : 2 * r;
+            for (int cx = bx - r; cx <= bx + r; cx += step) {
+                if (cx < 0 || cx >= buckets_per_side) {
+                    continue;
+                }
+                int b = cy * buckets_per_side + cx;
+                if (remaining[b] == 0) {
+                    continue;
+                }
+                for (int k = bucket_start[b]; k < bucket_start[b + 1]; ++k) {
+                    int i = items[k];
+                    if (store.isCollected(i)) {
+                        continue;
+                    }
+                    int dist = abs((int)store.x(i) - x) + abs((int)store.y(i) - y);
+                    if (dist < best_dist || (dist == best_dist && i < best)) {
+                        best = i;
+                        best_dist = dist;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+BotEngine::BotEngine(const GameBoard& board, const vector<int>& player_ids) : grid(board) {
+    bots.reserve(player_ids.size());
+    for (int id : player_ids) {
+        Bot bot = {id, -1, -1, 0};
+        bots.push_back(bot);
+    }
+}
+
+void BotEngine::plan(const GameBoard& board, size_t first, size_t last) {
+    const ItemStore& store = board.items;
+    for (size_t b = first; b < last; ++b) {
+        Bot& bot = bots[b];
+        const Player& player = board.players[bot.player_id];
+        if (bot.target < 0 || store.isCollected(bot.target)) {
+            bot.target = grid.nearest(board, player.x, player.y);
+            bot.replans++;
+        }
+        if (bot.target < 0) {
+            bot.dir = -1;  // Nothing left to collect
+            continue;
+        }
+        int dx = (int)store.x(bot.target) - player.x;
+        int dy = (int)store.y(bot.target) - player.y;
+        if (dx == 0 && dy == 0) {
+            // Started on top of an item; step off and come back for it
+            bot.dir = player.y > 0 ? 0 : 1;
+        } else if (abs(dx) >= abs(dy)) {
+            bot.dir = dx < 0 ? 2 : 3;
+        } else {
+            bot.dir = dy < 0 ? 0 : 1;
+        }
+    }
+}
+
+uint64_t BotEngine::replans() const {
+    uint64_t total = 0;
+    for (const auto& bot : bots) {
+        total += bot.replans;
+    }
+    return total;
+}
@@ -0,0 +1,75 @@
+#ifndef BOT_ENGINE_H
+#define BOT_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "game_board.h"
+
+// Items bucketed by board region, so a nearest-item query only looks at
+// the buckets around the player instead of every item. Items never move,
+// so the buckets are built once; sync() keeps a count of the uncollected
+// items in each bucket so empty ones are skipped without touching them.
+class ItemGrid {
+public:
+    explicit ItemGrid(const GameBoard& board);
+
+    // Bring the bucket counts up to date with the board's collected items.
+    // Not thread safe; call between planning rounds.
+    void sync(const GameBoard& board);
+
+    // Index of the uncollected item closest to (x, y) by Manhattan
+    // distance (lowest index on a tie), or -1 if there are none. Safe to
+    // call from several threads while the board isn't changing.
+    int nearest(const GameBoard& board, int x, int y) const;
+
+private:
+    int bucketOf(int x, int y) const {
+        return (y >> shift) * buckets_per_side + (x >> shift);
+    }
+
+    int shift;                        // Buckets are (1 << shift) cells square
+    int buckets_per_side;
+    std::vector<int> bucket_start;    // Items of bucket b: items[bucket_start[b] .. bucket_start[b + 1])
+    std::vector<int> items;
+    std::vector<int> remaining;       // Uncollected items per bucket
+    std::vector<uint64_t> seen;       // Collected bitset as of the last sync
+};
+
+// Controllers for bot players. Every bot heads for the nearest item it can
+// find and keeps that target cached until somebody collects it, so most
+// ticks a bot costs one bit test and a step. Planning for different bots
+// only reads the board, so ranges of bots can be planned in parallel.
+class BotEngine {
+public:
+    BotEngine(const GameBoard& board, const std::vector<int>& player_ids);
+
+    size_t size() const { return bots.size(); }
+    int playerId(size_t bot) const { return bots[bot].player_id; }
+
+    // Single-threaded step before each planning round
+    void sync(const GameBoard& board) { grid.sync(board); }
+
+    // Pick the next move of bots [first, last). Different ranges may be
+    // planned at the same time on different threads.
+    void plan(const GameBoard& board, size_t first, size_t last);
+
+    // Direction the bot chose in the last plan, or -1 to stand still
+    int move(size_t bot) const { return bots[bot].dir; }
+
+    // Targets picked since construction, i.e. cache misses
+    uint64_t replans() const;
+
+private:
+    struct Bot {
+        int player_id;
+        int target;       // Item the bot is heading for, or -1
+        int dir;
+        uint64_t replans;
+    };
+
+    ItemGrid grid;
+    std::vector<Bot> bots;
+};
+
+#endif // BOT_ENGINE_H
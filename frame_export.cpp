@@ -0,0 +1,302 @@
+#include "frame_export.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include "log.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace {
+
+// Frames being encoded at once, per pool worker
+const size_t FRAMES_IN_FLIGHT_PER_WORKER = 2;
+
+// Deflate's length codes 257..285: the shortest length each one stands
+// for, and how many extra bits follow it
+const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+// Bits going out least significant first, as deflate packs them
+struct BitWriter {
+    vector<uint8_t>& out;
+    uint64_t bits;
+    int count;
+
+    explicit BitWriter(vector<uint8_t>& out) : out(out), bits(0), count(0) {}
+
+    void put(uint32_t value, int n) {
+        bits |= (uint64_t)value << count;
+        count += n;
+        if (count >= 32) {
+            uint8_t bytes[4] = {(uint8_t)bits, (uint8_t)(bits >> 8), (uint8_t)(bits >> 16), (uint8_t)(bits >> 24)};
+            out.insert(out.end(), bytes, bytes + 4);
+            bits >>= 32;
+            count -= 32;
+        }
+    }
+
+    void flush() {
+        for (; count > 0; count -= 8) {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+        }
+        bits = 0;
+        count = 0;
+    }
+};
+
+// Deflate's fixed Huffman code for each literal/length symbol, already
+// bit-reversed for BitWriter::put
+struct FixedCodes {
+    uint16_t code[288];
+    uint8_t length[288];
+
+    FixedCodes() {
+        for (int symbol = 0; symbol < 288; ++symbol) {
+            uint32_t value;
+            int n;
+            if (symbol < 144) {
+                value = 0x30 + symbol;
+                n = 8;
+            } else if (symbol < 256) {
+                value = 0x190 + symbol - 144;
+                n = 9;
+            } else if (symbol < 280) {
+                value = symbol - 256;
+                n = 7;
+            } else {
+                value = 0xc0 + symbol - 280;
+                n = 8;
+            }
+            uint32_t reversed = 0;
+            for (int i = 0; i < n; ++i) {
+                reversed = (reversed << 1) | ((value >> i) & 1);
+            }
+            code[symbol] = (uint16_t)reversed;
+            length[symbol] = (uint8_t)n;
+        }
+    }
+};
+
+void putSymbol(BitWriter& bits, int symbol) {
+    static const FixedCodes fixed;
+    bits.put(fixed.code[symbol], fixed.length[symbol]);
+}
+
+// Copy the previous byte length more times: a match at distance 1
+void putRun(BitWriter& bits, int length) {
+    int code = 0;
+    while (code < 28 && LENGTH_BASE[code + 1] <= length) {
+        code++;
+    }
+    putSymbol(bits, 257 + code);
+    bits.put(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+    bits.put(0, 5);      // Distance code 0, distance 1
+}
+
+// One fixed-Huffman block holding data, as a zlib stream
+void deflateRuns(const vector<uint8_t>& data, vector<uint8_t>& out) {
+    out.push_back(0x78);  // Deflate, 32K window
+    out.push_back(0x01);  // Fastest compression, no dictionary
+    BitWriter bits(out);
+    bits.put(1, 1);       // Final block
+    bits.put(1, 2);       // Fixed Huffman codes
+    size_t n = data.size();
+    for (size_t i = 0; i < n;) {
+        uint8_t value = data[i];
+        putSymbol(bits, value);
+        size_t run = 0;
+        while (i + 1 + run < n && data[i + 1 + run] == value) {
+            run++;
+        }
+        i += 1 + run;
+        while (run >= 3) {
+            int length = (int)min(run, (size_t)258);
+            putRun(bits, length);
+            run -= length;
+        }
+        for (; run > 0; --run) {
+            putSymbol(bits, value);
+        }
+    }
+    putSymbol(bits, 256);  // End of block
+    bits.flush();
+
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < n;) {
+        // Sums stay within 32 bits for 5552 bytes between reductions
+        size_t chunk_end = min(n, i + 5552);
+        for (; i < chunk_end; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((uint8_t)(adler >> shift));
+    }
+}
+
+// The CRC-32 lookup table, built on first use
+struct CrcTable {
+    uint32_t entries[256];
+
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+uint32_t pngCrc(const uint8_t* data, size_t size) {
+    static const CrcTable table;
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void putU32(vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((uint8_t)(value >> shift));
+    }
+}
+
+void putChunk(vector<uint8_t>& out, const char* type, const vector<uint8_t>& data) {
+    putU32(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putU32(out, pngCrc(&out[start], out.size() - start));
+}
+
+}
+
+void encodePng(const uint8_t* rgb, int width, int height, vector<uint8_t>& out) {
+    TRACE_ZONE("encode_png");
+    const size_t stride = (size_t)width * 3;
+
+    // Filter each row with Sub or Up, whichever sums to less as signed bytes
+    vector<uint8_t> filtered;
+    filtered.reserve((stride + 1) * height);
+    vector<uint8_t> sub(stride);
+    vector<uint8_t> up(stride);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = rgb + y * stride;
+        const uint8_t* above = y > 0 ? row - stride : nullptr;
+        if (above && memcmp(row, above, stride) == 0) {
+            // Most rows of a frame repeat the one above: Up makes them zeros
+            filtered.push_back(2);
+            filtered.resize(filtered.size() + stride, 0);
+            continue;
+        }
+        uint32_t sub_cost = 0;
+        uint32_t up_cost = 0;
+        for (size_t i = 0; i < stride; ++i) {
+            sub[i] = (uint8_t)(row[i] - (i >= 3 ? row[i - 3] : 0));
+            up[i] = (uint8_t)(row[i] - (above ? above[i] : 0));
+            sub_cost += abs((int)(int8_t)sub[i]);
+            up_cost += abs((int)(int8_t)up[i]);
+        }
+        bool use_up = up_cost < sub_cost;
+        filtered.push_back(use_up ? 2 : 1);
+        const vector<uint8_t>& chosen = use_up ? up : sub;
+        filtered.insert(filtered.end(), chosen.begin(), chosen.end());
+    }
+
+    static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.assign(SIGNATURE, SIGNATURE + 8);
+    vector<uint8_t> header;
+    putU32(header, (uint32_t)width);
+    putU32(header, (uint32_t)height);
+    header.push_back(8);   // Bits per channel
+    header.push_back(2);   // RGB
+    header.push_back(0);   // Deflate
+    header.push_back(0);   // Adaptive filtering
+    header.push_back(0);   // Not interlaced
+    putChunk(out, "IHDR", header);
+    vector<uint8_t> compressed;
+    deflateRuns(filtered, compressed);
+    putChunk(out, "IDAT", compressed);
+    putChunk(out, "IEND", vector<uint8_t>());
+}
+
+FrameExporter::FrameExporter(const string& dir, FrameFormat format, ThreadPool* pool) :
+    dir(dir), format(format), pool(pool), next_frame(0), bytes(0), failed(false) {
+    size_t count = pool ? max<size_t>(2, pool->size() * FRAMES_IN_FLIGHT_PER_WORKER) : 1;
+    for (size_t i = 0; i < count; ++i) {
+        slots.emplace_back(new Slot());
+    }
+}
+
+FrameExporter::~FrameExporter() {
+    finish();
+}
+
+bool FrameExporter::open() {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("Failed to create {}", dir);
+        return false;
+    }
+    return true;
+}
+
+void FrameExporter::save(Slot& slot, size_t frame, int width, int height) {
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%06zu.%s", frame, format == FRAME_PNG ? "png" : "rgb");
+    const vector<uint8_t>* data = &slot.rgb;
+    if (format == FRAME_PNG) {
+        encodePng(&slot.rgb[0], width, height, slot.encoded);
+        data = &slot.encoded;
+    }
+    string path = dir + name;
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file && fwrite(&(*data)[0], 1, data->size(), file) == data->size();
+    if (file && fclose(file) != 0) {
+        ok = false;
+    }
+    if (ok) {
+        bytes.fetch_add(data->size(), memory_order_relaxed);
+    } else if (!failed.exchange(true)) {
+        LOG_ERROR("Failed to write {}", path);
+    }
+}
+
+void FrameExporter::write(const vector<uint8_t>& rgb, int width, int height) {
+    size_t frame = next_frame++;
+    Slot& slot = *slots[frame % slots.size()];
+    // Frames go round the slots in order, so this one's last frame is the
+    // oldest still in flight
+    slot.saving.wait();
+    slot.rgb = rgb;
+    if (!pool) {
+        save(slot, frame, width, height);
+        return;
+    }
+    slot.saving.add();
+    pool->submit([this, &slot, frame, width, height]() {
+        save(slot, frame, width, height);
+        slot.saving.done();
+    });
+}
+
+bool FrameExporter::finish() {
+    for (const auto& slot : slots) {
+        slot->saving.wait();
+    }
+    return !failed.load();
+}
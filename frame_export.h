@@ -0,0 +1,63 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+// Encode an RGB image as a PNG. The encoder is self-contained: each row
+// gets the Sub or Up filter, whichever leaves smaller values, and the
+// deflate stream only looks for runs of one byte (like zlib's Z_RLE),
+// which is what filtered flat-colored frames are mostly made of.
+void encodePng(const uint8_t* rgb, int width, int height, std::vector<uint8_t>& out);
+
+enum FrameFormat { FRAME_PNG, FRAME_RAW };
+
+// Writes frames to dir as frame_000000.png, frame_000001.png and so on,
+// or as .rgb files of bare pixels. Frames are encoded and written on the
+// pool, a few at a time, so the caller can draw the next frame meanwhile;
+// with no pool, write() does it all before returning.
+class FrameExporter {
+public:
+    FrameExporter(const std::string& dir, FrameFormat format, ThreadPool* pool = nullptr);
+    ~FrameExporter();
+
+    // Create dir if needed
+    bool open();
+
+    // Queue a frame of width x height RGB pixels; copies them
+    void write(const std::vector<uint8_t>& rgb, int width, int height);
+
+    // Wait for every queued frame; false if any failed to write
+    bool finish();
+
+    size_t frames() const { return next_frame; }
+    uint64_t bytesWritten() const { return bytes.load(std::memory_order_relaxed); }
+
+private:
+    FrameExporter(const FrameExporter&);
+    FrameExporter& operator=(const FrameExporter&);
+
+    // One frame being encoded and written
+    struct Slot {
+        std::vector<uint8_t> rgb;
+        std::vector<uint8_t> encoded;
+        WaitGroup saving;  // The pool task saving rgb, if any
+    };
+
+    void save(Slot& slot, size_t frame, int width, int height);
+
+    std::string dir;
+    FrameFormat format;
+    ThreadPool* pool;
+    std::vector<std::unique_ptr<Slot> > slots;
+    size_t next_frame;
+    std::atomic<uint64_t> bytes;
+    std::atomic<bool> failed;
+};
+
+#endif // FRAME_EXPORT_H
@@ -1,576 +1,1357 @@
-#include <pthread.h>
 #include <vector>
 #include <random>
 #include <cmath>
 #include <unistd.h>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <queue>
-#include <fcntl.h>
-#include <sys/time.h>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <csignal>
+#include <poll.h>
 #include "/opt/homebrew/Cellar/sdl2/2.30.9/include/SDL2/SDL.h"
+#include "message_queue.h"
+#include "thread_pool.h"
+#include "audio_mixer.h"
+#include "metrics.h"
+#include "game_board.h"
+#include "snapshot.h"
+#include "render.h"
+#include "net_client.h"
+#include "game_server.h"
+#include "replay.h"
+#include "term_render.h"
+#include "bot_engine.h"
+#include "session.h"
+#include "move_resolver.h"
+#include "rollback.h"
+#include "shm_input.h"
+#include "soft_render.h"
+#include "frame_export.h"
+#include "log.h"
+#include "trace.h"
 
 using namespace std;
 
-// Message structure for thread communication
-struct GameMessage {
-    enum Type { MOVE, COLLECT, QUIT } type;
-    int player_id;
-    int dx;
-    int dy;
-    int item_index;
+// Global flag for game state, shared by the render and simulation threads
+atomic<bool> running(true);
+
+// Input from every producer thread (keyboard threads and pool workers)
+// fans in to the game loop through one lock-free lane per thread
+const size_t INPUT_LANE_SIZE = 1024;
+typedef FanInQueue<GameMessage, INPUT_LANE_SIZE> InputQueue;
+InputQueue* inputQueue = nullptr;
+
+// Inputs lost to full lanes so far
+size_t droppedInputs() {
+    return inputQueue ? inputQueue->droppedCount() : 0;
+}
+
+// Moves from other processes (--shm-input), drained alongside inputQueue
+ShmInputRing* shmInput = nullptr;
+
+// Runs bot controllers; its worker i posts into input lane i
+ThreadPool* workerPool = nullptr;
+
+// Input lane for bots the simulation thread plans itself
+size_t simulationLane = 0;
+
+// Set when playing on a server (--connect) instead of simulating locally
+ServerConnection* server = nullptr;
+
+// Logs every applied move when recording (--record)
+ReplayWriter* recorder = nullptr;
+
+// Where --trace writes the trace zones, at exit and when F4 is pressed
+string tracePath;
+
+void writeTraceFile() {
+    if (!writeTrace(tracePath)) {
+        LOG_ERROR("Failed to write {}", tracePath);
+    }
+}
+
+// Latest board state, from the simulation thread to the renderer
+SnapshotBuffer snapshots;
+
+// Function declarations
+void runSimulation();
+void runRenderLoop();
+
+// Controllers for every player without a keyboard. Planning runs as
+// tasks on workerPool rather than on a thread per bot.
+BotEngine* botEngine = nullptr;
+const size_t BOTS_PER_TASK = 32;
+
+// Run task(first, last) over all bots in chunks on workerPool, the
+// calling thread taking chunks too, and wait until every chunk is done
+void forEachBotChunk(const function<void(size_t, size_t)>& task) {
+    size_t count = botEngine->size();
+    workerPool->parallelFor((count + BOTS_PER_TASK - 1) / BOTS_PER_TASK, [&task, count](size_t chunk) {
+        size_t first = chunk * BOTS_PER_TASK;
+        task(first, min(first + BOTS_PER_TASK, count));
+    });
+}
+
+// Plan a chunk of bots and post their moves into the input lane of the
+// worker or, for chunks the simulation thread takes, into its own
+void runBots(size_t first, size_t last) {
+    TRACE_ZONE("plan_bots");
+    int worker = ThreadPool::currentWorker();
+    size_t lane = worker >= 0 ? (size_t)worker : simulationLane;
+    botEngine->plan(*game, first, last);
+    for (size_t i = first; i < last; ++i) {
+        int dir = botEngine->move(i);
+        if (dir >= 0) {
+            inputQueue->post(lane, makeMove(botEngine->playerId(i), dir));
+        }
+    }
+}
+
+// Give every bot its next move. Planning reads the board, so the
+// simulation waits for it before applying more input; the moves arrive
+// with the next tick's drain.
+void planBots() {
+    if (!botEngine || botEngine->size() == 0) {
+        return;
+    }
+    botEngine->sync(*game);
+    forEachBotChunk(runBots);
+}
+
+// Keyboard controls for the players that have them
+struct KeyMap {
+    SDL_Scancode keys[4];  // Indexed by direction: up, down, left, right
 };
 
-// Global flag for game state
-bool running = true;
+const KeyMap PLAYER_KEYS[] = {
+    {{SDL_SCANCODE_W, SDL_SCANCODE_S, SDL_SCANCODE_A, SDL_SCANCODE_D}},        // Player 1
+    {{SDL_SCANCODE_UP, SDL_SCANCODE_DOWN, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT}},  // Player 2
+};
+const int NUM_KEYBOARD_PLAYERS = sizeof(PLAYER_KEYS) / sizeof(PLAYER_KEYS[0]);
 
-// Pipe file descriptors for each player
-int player1_pipe[2];
-int player2_pipe[2];
+// Key repeat while a direction is held: the first move happens on key down,
+// the next one repeat_delay ms later, then one every repeat_interval ms
+Uint32 repeatDelay = 150;
+Uint32 repeatInterval = 33;
 
-struct Player {
-    int x, y;
-    int score;
-    char symbol;
-    int priority;
-    
-    Player(int startX, int startY, char sym, int prio) : 
-        x(startX), y(startY), score(0), symbol(sym), priority(prio) {}
+// Keyboard state of one player, updated from SDL key events on the main thread
+struct KeyboardPlayer {
+    int player_id;
+    int keys;            // Index into PLAYER_KEYS
+    bool held[4];
+    int dir;             // Direction being repeated, or -1
+    Uint32 next_repeat;
 };
 
-struct Item {
-    int x, y;
-    bool collected;
-    
-    Item(int posX, int posY) : 
-        x(posX), y(posY), collected(false) {}
+vector<KeyboardPlayer> keyboardPlayers;
+size_t keyboardLane = 0;  // Input lane owned by the main thread
+
+// --input-delay: keyboard moves wait here for a random 0..inputDelayMs ms
+// before reaching the simulation, as if they came over a slow link. They
+// keep their creation time, so the simulation still applies them at the
+// tick they were made in, by rolling back.
+struct DelayedMove {
+    uint64_t due_ns;
+    GameMessage msg;
 };
+int inputDelayMs = 0;
+vector<DelayedMove> delayedMoves;
+mt19937 delayGen(random_device{}());
+
+// Hand a keyboard move to the simulation, or to the server when connected
+void postKeyboardMove(int player_id, int dir) {
+    if (server) {
+        server->sendInput(dir);
+    } else if (inputDelayMs > 0) {
+        uint64_t delay_ns = delayGen() % (inputDelayMs + 1) * 1000000ULL;
+        DelayedMove delayed = {nowNs() + delay_ns, makeMove(player_id, dir)};
+        delayedMoves.push_back(delayed);
+    } else {
+        inputQueue->post(keyboardLane, makeMove(player_id, dir));
+    }
+}
 
-class GameBoard {
-public:
-    int board_size;
-    vector<Player> players;
-    vector<Item> items;
+// Post the delayed keyboard moves that are due
+void postDelayedMoves() {
+    uint64_t now = nowNs();
+    size_t kept = 0;
+    for (const auto& delayed : delayedMoves) {
+        if (delayed.due_ns <= now) {
+            inputQueue->post(keyboardLane, delayed.msg);
+        } else {
+            delayedMoves[kept++] = delayed;
+        }
+    }
+    delayedMoves.resize(kept);
+}
+
+// Milliseconds until the next delayed move is due, capped at limit
+int msUntilDelayedMove(int limit) {
+    uint64_t now = nowNs();
+    for (const auto& delayed : delayedMoves) {
+        uint64_t wait_ns = delayed.due_ns > now ? delayed.due_ns - now : 0;
+        limit = min(limit, (int)((wait_ns + 999999) / 1000000));
+    }
+    return limit;
+}
+
+void handleKeyEvent(const SDL_KeyboardEvent& key, Uint32 now) {
+    if (key.repeat) {
+        return;  // We do our own repeat at the configured rate
+    }
+    bool down = key.type == SDL_KEYDOWN;
     
-    GameBoard() {
-        calculateBoardSize();
-        initializePlayers();
-        initializeItems();
+    for (auto& kp : keyboardPlayers) {
+        const KeyMap& keyMap = PLAYER_KEYS[kp.keys];
+        for (int dir = 0; dir < 4; ++dir) {
+            if (keyMap.keys[dir] != key.keysym.scancode) {
+                continue;
+            }
+            kp.held[dir] = down;
+            if (down) {
+                // The newest key wins and moves right away
+                kp.dir = dir;
+                kp.next_repeat = now + repeatDelay;
+                postKeyboardMove(kp.player_id, dir);
+            } else if (kp.dir == dir) {
+                // Fall back to another direction that is still held
+                kp.dir = -1;
+                for (int other = 0; other < 4; ++other) {
+                    if (kp.held[other]) {
+                        kp.dir = other;
+                        kp.next_repeat = now + repeatInterval;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Post a move for every held key whose repeat is due
+void fireKeyRepeats(Uint32 now) {
+    for (auto& kp : keyboardPlayers) {
+        if (kp.dir < 0 || (int)(now - kp.next_repeat) < 0) {
+            continue;
+        }
+        postKeyboardMove(kp.player_id, kp.dir);
+        kp.next_repeat += repeatInterval;
+        if ((int)(now - kp.next_repeat) >= 0) {
+            // We overslept; skip the missed repeats instead of bursting them
+            metrics.coalesced += (now - kp.next_repeat) / repeatInterval + 1;
+            kp.next_repeat = now + repeatInterval;
+        }
+    }
+}
+
+// Milliseconds until the next key repeat is due, capped at limit
+int msUntilKeyRepeat(Uint32 now, int limit) {
+    for (const auto& kp : keyboardPlayers) {
+        if (kp.dir >= 0) {
+            limit = min(limit, max(0, (int)(kp.next_repeat - now)));
+        }
+    }
+    return limit;
+}
+
+void handleEvent(const SDL_Event& event) {
+    if (event.type == SDL_QUIT) {
+        running = false;
+    } else if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F3) {
+        if (!event.key.repeat) {
+            statsOverlay.visible = !statsOverlay.visible;
+            renderCache.dirty = true;
+        }
+    } else if (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_F4) {
+        if (!event.key.repeat && !tracePath.empty()) {
+            writeTraceFile();
+            LOG_INFO("Wrote the last few seconds of trace zones to {}", tracePath);
+        }
+    } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+        handleKeyEvent(event.key, SDL_GetTicks());
+    } else if (event.type == SDL_WINDOWEVENT) {
+        renderCache.dirty = true;  // Exposed, resized, restored...
+    } else if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET) {
+        invalidateRenderCache();
+    }
+}
+
+// Simulation and frame rates, set from --tick-rate and --fps
+int tickRate = 60;
+int frameRate = 60;
+const Uint32 GAME_OVER_MS = 5000;  // How long the game over screen stays up
+
+// Ticks of history kept for late input. An input can arrive up to
+// ROLLBACK_TICKS - 1 ticks after the one it was meant for and still be
+// applied there.
+const size_t ROLLBACK_TICKS = 32;
+
+// Log a finalized tick's moves when recording
+void recordTick(uint32_t tick, const vector<RollbackSimulation::Move>& moves) {
+    for (const auto& move : moves) {
+        recorder->record(tick, move.player_id, move.dir);
     }
+}
+
+// Simulation thread: resolves each tick's input as one batch and advances
+// bots once per fixed tick, then publishes the result for the renderer.
+// Input that arrives late (--input-delay) is applied at the tick it was
+// made in by rolling back. Stops ticking once the game is over.
+void runSimulation() {
+    TRACE_THREAD("simulation");
+    typedef chrono::steady_clock Clock;
+    const Clock::duration tick = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / tickRate));
+    Clock::time_point next_tick = Clock::now();
     
-private:
-    void calculateBoardSize() {
-        random_device rd;
-        mt19937 gen(rd());
-        uniform_int_distribution<> dis(10, 99);
-        
-        int random_num = dis(gen);
-        int calc_1 = random_num * 3;
-        int board_size_calc = calc_1 % 25;
+    RollbackSimulation sim(*game, ROLLBACK_TICKS);
+    if (recorder) {
+        sim.onFinal(recordTick);
+    }
+    // When each recent tick drained its input: an input belongs to the
+    // first tick that drained after it was made
+    vector<uint64_t> drained_ns(ROLLBACK_TICKS);
+    const uint64_t NO_MOVE = ~0ULL;
+    vector<GameMessage> inputs;
+    vector<uint64_t> handles;  // Each input's move in sim, or NO_MOVE
+    vector<InputStamp> applied;
+    while (running && !isGameOver()) {
+        TRACE_ZONE("tick");
+        uint64_t tick_start = nowNs();
+        drained_ns[sim.tick() % ROLLBACK_TICKS] = tick_start;
+        {
+            TRACE_ZONE("drain_input");
+            auto take = [&](GameMessage& msg) {
+                msg.dequeued_ns = nowNs();
+                int dir = directionOf(msg.dx, msg.dy);
+                uint64_t handle = NO_MOVE;
+                if (msg.type == GameMessage::MOVE && dir >= 0 &&
+                    msg.player_id >= 0 && msg.player_id < (int)game->players.size()) {
+                    uint32_t made_in = sim.tick();
+                    while (made_in > sim.oldestTick() &&
+                           drained_ns[(made_in - 1) % ROLLBACK_TICKS] >= msg.created_ns) {
+                        made_in--;
+                    }
+                    handle = sim.add(made_in, msg.player_id, dir);
+                }
+                handles.push_back(handle);
+                inputs.push_back(msg);
+            };
+            inputQueue->drain(take);
+            if (shmInput) {
+                shmInput->drain([&](const ShmMove& move) {
+                    // Another process's word for everything: a bad
+                    // direction fails the check in take, and a clock from
+                    // the future counts as now
+                    GameMessage msg = {GameMessage::MOVE, move.player_id, 0, 0, -1,
+                                       min(move.created_ns, nowNs()), 0};
+                    if (move.dir >= 0 && move.dir < 4) {
+                        msg.dx = DIR_DX[move.dir];
+                        msg.dy = DIR_DY[move.dir];
+                    }
+                    take(msg);
+                });
+            }
+        }
+        sim.advance(workerPool);
+        uint64_t applied_ns = nowNs();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            const GameMessage& msg = inputs[i];
+            metrics.queueLatency.record(msg.dequeued_ns - msg.created_ns);
+            metrics.applyLatency.record(applied_ns - msg.dequeued_ns);
+            metrics.messages.fetch_add(1, memory_order_relaxed);
+            if (handles[i] != NO_MOVE && sim.moved(handles[i])) {
+                // Only inputs that changed the board ever reach the screen
+                InputStamp stamp = {msg.created_ns, applied_ns};
+                applied.push_back(stamp);
+            }
+        }
+        inputs.clear();
+        handles.clear();
+        planBots();
+        {
+            TRACE_ZONE("publish_snapshot");
+            snapshots.publish(*game, applied);
+        }
+        metrics.tickTime.record(nowNs() - tick_start);
+        metrics.ticks.fetch_add(1, memory_order_relaxed);
         
-        if (board_size_calc < 10) {
-            board_size_calc += 15;
+        next_tick += tick;
+        Clock::time_point now = Clock::now();
+        if (now > next_tick + tick) {
+            next_tick = now;  // Fell behind (e.g. suspended); don't try to catch up
+        }
+        this_thread::sleep_until(next_tick);
+    }
+    sim.finish();
+    if (sim.replayed() > 0) {
+        LOG_INFO("Replayed {} ticks for late input", sim.replayed());
+    }
+}
+
+// Render loop on the main thread, which SDL requires for events and
+// rendering: turns events into input, and draws the newest snapshot at
+// up to frameRate frames per second (presents also wait for vsync). The
+// game over screen is a timed state, after which the loop ends.
+void runRenderLoop() {
+    SDL_Event event;
+    const Uint32 frame_ms = max(1, 1000 / frameRate);
+    Uint32 next_frame = SDL_GetTicks();
+    GameSnapshot snapshot;
+    bool gameOver = false;
+    Uint32 gameOverAt = 0;
+    
+    while (running) {
+        // Sleep until an event arrives, a held key repeats or the next frame
+        // is due
+        Uint32 now = SDL_GetTicks();
+        int timeout = msUntilDelayedMove(msUntilKeyRepeat(now, max(0, (int)(next_frame - now))));
+        bool woken;
+        {
+            TRACE_ZONE("wait_events");
+            woken = SDL_WaitEventTimeout(&event, timeout);
+        }
+        if (woken) {
+            TRACE_ZONE("handle_events");
+            handleEvent(event);
+            while (SDL_PollEvent(&event)) {
+                handleEvent(event);
+            }
         }
         
-        board_size = board_size_calc;
+        now = SDL_GetTicks();
+        fireKeyRepeats(now);
+        postDelayedMoves();
+        
+        if ((int)(now - next_frame) >= 0) {
+            snapshots.acquire(snapshot);
+            if (!gameOver && snapshot.items_remaining == 0) {
+                gameOver = true;
+                gameOverAt = now;
+            }
+            if (gameOver && now - gameOverAt >= GAME_OVER_MS) {
+                running = false;
+                break;
+            }
+            if (statsOverlay.visible && updateStatsOverlay(now, droppedInputs())) {
+                renderCache.dirty = true;
+            }
+            
+            uint64_t frame_start = nowNs();
+            if (renderGame(snapshot, gameOver)) {
+                uint64_t presented = nowNs();
+                for (const auto& input : snapshot.inputs) {
+                    metrics.presentLatency.record(presented - input.applied_ns);
+                    metrics.inputToPhoton.record(presented - input.created_ns);
+                }
+                snapshot.inputs.clear();
+                metrics.frameTime.record(presented - frame_start);
+                metrics.frames.fetch_add(1, memory_order_relaxed);
+            }
+            next_frame += frame_ms;
+            if ((int)(now - next_frame) >= 0) {
+                next_frame = now + frame_ms;
+            }
+        }
     }
+}
+
+// Front end for --renderer term: the same job as runRenderLoop, drawing
+// the board as text on stdout and reading moves from stdin
+void runTerminalLoop() {
+    typedef chrono::steady_clock Clock;
+    const Clock::duration frame = chrono::milliseconds(max(1, 1000 / frameRate));
+    const Clock::duration game_over_time = chrono::milliseconds(GAME_OVER_MS);
+    Clock::time_point next_frame = Clock::now();
+    Clock::time_point game_over_at;
+    GameSnapshot snapshot;
+    bool gameOver = false;
     
-    void initializePlayers() {
-        players.emplace_back(0, 0, '1', 1);  // Player 1 with priority 1
-        players.emplace_back(board_size-1, board_size-1, '2', 1);  // Player 2 with priority 1
+    TerminalRenderer term;
+    if (!keyboardPlayers.empty()) {
+        term.follow(keyboardPlayers[0].player_id);
     }
+    TerminalInput input;
+    input.open();
+    vector<pair<int, int> > moves;
     
-    void initializeItems() {
-        int num_items = board_size * 2;
-        random_device rd;
-        mt19937 gen(rd());
-        uniform_int_distribution<> dis(0, board_size-1);
+    while (running) {
+        Clock::time_point now = Clock::now();
+        int timeout = next_frame > now ? (int)chrono::duration_cast<chrono::milliseconds>(next_frame - now).count() : 0;
+        timeout = msUntilDelayedMove(timeout);
+        moves.clear();
+        bool open;
+        {
+            TRACE_ZONE("read_input");
+            open = input.readMoves(timeout, moves);
+        }
+        if (!open) {
+            running = false;
+            break;
+        }
+        for (const auto& move : moves) {
+            for (const auto& kp : keyboardPlayers) {
+                if (kp.keys == move.first) {
+                    postKeyboardMove(kp.player_id, move.second);
+                }
+            }
+        }
+        postDelayedMoves();
+        
+        now = Clock::now();
+        if (now < next_frame) {
+            continue;
+        }
+        snapshots.acquire(snapshot);
+        if (!gameOver && snapshot.items_remaining == 0) {
+            gameOver = true;
+            game_over_at = now;
+        }
+        if (gameOver && now - game_over_at >= game_over_time) {
+            running = false;
+            break;
+        }
         
-        for (int i = 0; i < num_items; ++i) {
-            items.emplace_back(dis(gen), dis(gen));
+        TRACE_ZONE("frame");
+        uint64_t frame_start = nowNs();
+        if (term.draw(snapshot, gameOver)) {
+            uint64_t presented = nowNs();
+            for (const auto& stamp : snapshot.inputs) {
+                metrics.presentLatency.record(presented - stamp.applied_ns);
+                metrics.inputToPhoton.record(presented - stamp.created_ns);
+            }
+            snapshot.inputs.clear();
+            metrics.frameTime.record(presented - frame_start);
+            metrics.frames.fetch_add(1, memory_order_relaxed);
+        }
+        next_frame += frame;
+        if (now >= next_frame) {
+            next_frame = now + frame;
         }
     }
-};
+    term.close();
+}
 
-GameBoard* game;
-void audioCallback(void* userdata, Uint8* stream, int len);
-void playBeep();
+// Front end for --renderer none: nothing to draw, just wait for the game
+// to end (or a signal)
+void runWithoutDisplay() {
+    GameSnapshot snapshot;
+    while (running) {
+        snapshots.acquire(snapshot);
+        if (snapshot.items_remaining == 0) {
+            running = false;
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+}
 
-// Function declarations
-bool movePlayer(Player& player, int dx, int dy);
-void displayGame();
-void renderGame();
-void processMessages();
-void* handlePlayer1Input(void* arg);
-void* handlePlayer2Input(void* arg);
-
-// Constants for graphics
-const int SCREEN_SIZE = 800;
-const int CELL_PADDING = 2;
-SDL_Window* window = nullptr;
-SDL_Renderer* renderer = nullptr;
-
-// Add colors for graphics
-struct Color {
-    Uint8 r, g, b;
-    Color(Uint8 red, Uint8 green, Uint8 blue) : r(red), g(green), b(blue) {}
-};
+// Where frames go: the SDL window, the terminal or nowhere
+enum RendererKind { RENDERER_SDL, RENDERER_TERM, RENDERER_NONE };
+RendererKind rendererKind = RENDERER_SDL;
 
-const Color PLAYER1_COLOR(255, 0, 0);    // Red
-const Color PLAYER2_COLOR(0, 0, 255);    // Blue
-const Color ITEM_COLOR(0, 255, 0);       // Green
-const Color GRID_COLOR(200, 200, 200);   // Light Gray
-const Color BG_COLOR(255, 255, 255);     // White
-
-// Add this helper function to draw individual digits
-void drawDigit(int digit, int x, int y, int width, int height) {
-    // Declare rect outside switch
-    SDL_Rect rect;
-    
-    switch(digit) {
-        case 0:
-            // Draw a rectangle for 0
-            rect = {x, y, width, height};
-            SDL_RenderDrawRect(renderer, &rect);
-            break;
-        case 1:
-            // Vertical line for 1
-            SDL_RenderDrawLine(renderer, x + width/2, y, x + width/2, y + height);
-            break;
-        case 2:
-            // Top horizontal
-            SDL_RenderDrawLine(renderer, x, y, x + width, y);
-            // Middle horizontal
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            // Bottom horizontal
-            SDL_RenderDrawLine(renderer, x, y + height, x + width, y + height);
-            // Top right vertical
-            SDL_RenderDrawLine(renderer, x + width, y, x + width, y + height/2);
-            // Bottom left vertical
-            SDL_RenderDrawLine(renderer, x, y + height/2, x, y + height);
-            break;
-        case 3:
-            // Three horizontal lines
-            SDL_RenderDrawLine(renderer, x, y, x + width, y);
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            SDL_RenderDrawLine(renderer, x, y + height, x + width, y + height);
-            // Right vertical line
-            SDL_RenderDrawLine(renderer, x + width, y, x + width, y + height);
-            break;
-        case 4:
-            // Top vertical line
-            SDL_RenderDrawLine(renderer, x, y, x, y + height/2);
-            // Middle horizontal line
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            // Right vertical line
-            SDL_RenderDrawLine(renderer, x + width, y, x + width, y + height);
-            break;
-        case 5:
-            // Horizontal lines
-            SDL_RenderDrawLine(renderer, x, y, x + width, y);
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            SDL_RenderDrawLine(renderer, x, y + height, x + width, y + height);
-            // Top left vertical
-            SDL_RenderDrawLine(renderer, x, y, x, y + height/2);
-            // Bottom right vertical
-            SDL_RenderDrawLine(renderer, x + width, y + height/2, x + width, y + height);
-            break;
-        case 6:
-            // Horizontal lines
-            SDL_RenderDrawLine(renderer, x, y, x + width, y);
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            SDL_RenderDrawLine(renderer, x, y + height, x + width, y + height);
-            // Left vertical
-            SDL_RenderDrawLine(renderer, x, y, x, y + height);
-            // Bottom right vertical
-            SDL_RenderDrawLine(renderer, x + width, y + height/2, x + width, y + height);
-            break;
-        case 7:
-            // Top horizontal
-            SDL_RenderDrawLine(renderer, x, y, x + width, y);
-            // Right vertical
-            SDL_RenderDrawLine(renderer, x + width, y, x + width, y + height);
-            break;
-        case 8:
-            // All lines
-            rect = {x, y, width, height};
-            SDL_RenderDrawRect(renderer, &rect);
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            break;
-        case 9:
-            // Horizontal lines
-            SDL_RenderDrawLine(renderer, x, y, x + width, y);
-            SDL_RenderDrawLine(renderer, x, y + height/2, x + width, y + height/2);
-            // Right vertical
-            SDL_RenderDrawLine(renderer, x + width, y, x + width, y + height);
-            // Top left vertical
-            SDL_RenderDrawLine(renderer, x, y, x, y + height/2);
+// Run the chosen front end on the main thread until the game ends or the
+// player quits
+void runFrontEnd() {
+    switch (rendererKind) {
+    case RENDERER_SDL:
+        runRenderLoop();
+        break;
+    case RENDERER_TERM:
+        runTerminalLoop();
+        break;
+    case RENDERER_NONE:
+        runWithoutDisplay();
+        break;
+    }
+}
+
+// Hand the renderer the starting board. Called on the main thread before
+// the thread that updates the board starts, so the first frame never finds
+// the buffer empty (a snapshot with no view to scale to the screen).
+void publishFirstSnapshot() {
+    vector<InputStamp> none;
+    snapshots.publish(*game, none);
+}
+
+// Network thread when playing on a server: applies the server's deltas to
+// the mirrored board and hands it to the renderer, in place of
+// runSimulation. Keyboard moves go straight to the server from the main
+// thread.
+void runNetworkClient(ClientGame& remote) {
+    TRACE_THREAD("network");
+    vector<InputStamp> none;
+    pollfd pfd = {server->fd(), POLLIN, 0};
+    while (running) {
+        {
+            TRACE_ZONE("wait_server");
+            poll(&pfd, 1, 100);
+        }
+        TRACE_ZONE("receive");
+        if (!server->receive(remote)) {
+            LOG_ERROR("Disconnected from the server");
+            running = false;
             break;
+        }
+        snapshots.publish(*game, none);
     }
 }
 
-// Update renderScore function to use the digit drawing
-void renderScore(int x, int y, int score, const Color& color) {
-    // Draw background
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
-    SDL_Rect scoreBackground = {
-        x,
-        y,
-        100,
-        50
-    };
-    SDL_RenderFillRect(renderer, &scoreBackground);
-    
-    // Draw label (P1 or P2)
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    string label = (color.r == PLAYER1_COLOR.r) ? "P1:" : "P2:";
-    SDL_Rect labelRect = {
-        x + 5,
-        y + 10,
-        30,
-        30
-    };
-    SDL_RenderDrawRect(renderer, &labelRect);
+// Build the board a replay was recorded on, big ones on pool; null if
+// the header is bad
+GameBoard* makeReplayBoard(const ReplayHeader& header, ThreadPool* pool = nullptr) {
+    if (header.size > (uint32_t)MAX_BOARD_SIZE || header.items > 0x7FFFFFFFu) {
+        LOG_ERROR("Replay has a bad board size or item count");
+        return nullptr;
+    }
+    GameBoard* board = new GameBoard(header.seed, (int)header.size, (int)header.players, (int)header.items, pool);
+    board->rules.respawn_ticks = (int)header.respawn_ticks;
+    board->rules.powerup_ticks = (int)header.powerup_ticks;
+    return board;
+}
+
+// Replay thread in place of runSimulation: applies the recorded moves at
+// the tick rate they were recorded at
+void runReplay(ReplayReader& replay) {
+    TRACE_THREAD("replay");
+    typedef chrono::steady_clock Clock;
+    const Clock::duration tick = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / tickRate));
+    Clock::time_point next_tick = Clock::now();
+    
+    MoveResolver moves;  // The next tick group, until its tick comes up
+    auto hold = [&moves](int player_id, int dir) { moves.add(player_id, dir); };
+    uint32_t group_tick = 0;
+    bool more = replay.nextTick(group_tick, hold);
     
-    // Draw score digits
-    string scoreStr = to_string(score);
-    int digitWidth = 20;
-    int digitHeight = 30;
-    int startX = x + 45;
+    vector<InputStamp> none;
+    for (uint32_t tick_number = 0; running && more; ++tick_number) {
+        runTimers(*game, tick_number);
+        while (more && group_tick == tick_number) {
+            moves.resolve(*game);
+            more = replay.nextTick(group_tick, hold);
+        }
+        snapshots.publish(*game, none);
+        
+        next_tick += tick;
+        Clock::time_point now = Clock::now();
+        if (now > next_tick + tick) {
+            next_tick = now;
+        }
+        this_thread::sleep_until(next_tick);
+    }
+    if (running) {
+        cout << "Replay finished; close the window to quit" << endl;
+    }
+}
+
+// Audio constants
+const int SAMPLE_RATE = 44100;
+const SoundEvent COLLECT_SOUND = {800.0f, 100, 16000};  // 800 Hz beep for 100ms
+AudioMixer mixer;
+
+// Function to play beep sound. Only queues it for the mixer, so it never
+// holds up the game loop; does nothing in headless mode.
+void playBeep() {
+    mixer.play(COLLECT_SOUND);
+}
+
+// Command line options
+struct GameOptions {
+    bool headless;
+    bool has_seed;
+    uint32_t seed;
+    int board_size;      // 0 = derive from the seed
+    int games;           // Headless only
+    long max_moves;      // Headless only: give up on a game after this many moves
+    string script_path;  // Headless only: scripted input instead of random
+    int players;         // Players beyond the keyboard ones are bots
+    bool bots;           // Every player is a bot, keyboard ones included
+    int threads;         // Worker pool size for bots
+    int repeat_delay;    // Key repeat delay in ms
+    int repeat_rate;     // Key repeats per second
+    int tick_rate;       // Simulation ticks per second
+    int fps;             // Frame rate cap
+    bool stats;          // Show the latency overlay from the start
+    string stats_json;   // Write latency metrics here at exit
+    string trace_path;   // Record trace zones and write them here at exit
+    int server_port;     // Run a game server on this port (0 = don't)
+    string connect;      // Play on the server at host:port
+    int clients;         // Headless with --connect: number of load clients
+    int input_rate;      // Load clients: moves per second each
+    int duration;        // Load clients: seconds to run at most
+    string record_path;  // Record every applied move to this replay file
+    string replay_path;  // Play back this replay file instead of a new game
+    int sessions;        // Headless: run this many games at once on the worker pool
+    int input_delay;     // Deliver input up to this many ms late
+    BoardRules rules;    // Item respawns and power-ups
+    bool shm_input;      // Take moves from other processes through shared memory
+    string export_dir;   // Headless replay: write its frames here
+    FrameFormat export_format;
+    RendererKind renderer;
+    bool has_log_level;
+    LogLevel log_level;  // Default: info, or warn where output is summaries
     
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    for (char c : scoreStr) {
-        int digit = c - '0';
-        drawDigit(digit, startX, y + 10, digitWidth, digitHeight);
-        startX += digitWidth + 5;
+    GameOptions() : headless(false), has_seed(false), seed(0), board_size(0),
+                    games(1), max_moves(1000000), players(2), bots(false),
+                    threads((int)thread::hardware_concurrency()),
+                    repeat_delay(150), repeat_rate(30), tick_rate(60), fps(60), stats(false),
+                    server_port(0), clients(1), input_rate(10), duration(10), sessions(0), input_delay(0),
+                    shm_input(false), export_format(FRAME_PNG),
+                    renderer(RENDERER_SDL), has_log_level(false), log_level(LOG_LEVEL_INFO) {}
+};
+
+void printUsage(const char* prog) {
+    cerr << "Usage: " << prog << " [options]\n"
+         << "  --seed N          Seed the board (and headless input) for reproducible games\n"
+         << "  --board-size N    Use an N x N board instead of a random size\n"
+         << "  --players N       Number of players (default 2); players 3 and up are bots\n"
+         << "  --bots            Make every player a bot (headless: instead of random input)\n"
+         << "  --threads N       Worker threads for bots (default: one per core)\n"
+         << "  --repeat-delay MS Delay before a held key starts repeating (default 150)\n"
+         << "  --repeat-rate N   Moves per second while a key is held (default 30)\n"
+         << "  --tick-rate N     Simulation ticks per second (default 60)\n"
+         << "  --fps N           Frame rate cap (default 60; presents also wait for vsync)\n"
+         << "  --stats           Show the latency overlay (toggle with F3)\n"
+         << "  --stats-json FILE Write latency histograms and counters to FILE at exit\n"
+         << "  --trace FILE      Record trace zones and write them to FILE as Chrome\n"
+         << "                    trace JSON at exit (and on F4)\n"
+         << "  --renderer R      sdl (default), term (text on this terminal) or none\n"
+         << "  --headless        Simulate without video or audio\n"
+         << "  --games N         Headless: number of games to run back to back (default 1)\n"
+         << "  --max-moves N     Headless: move limit per game (default 1000000)\n"
+         << "  --script FILE     Headless: read moves from FILE instead of random input\n"
+         << "  --server PORT     Run a game server with --players slots (no window)\n"
+         << "  --connect H:P     Play on the server at host H, port P\n"
+         << "  --clients N       Headless with --connect: run N load clients (default 1)\n"
+         << "  --input-rate N    Load clients: moves per second each (default 10)\n"
+         << "  --duration S      Load clients and headless --shm-input: stop after S seconds\n"
+         << "                    (default 10)\n"
+         << "  --record FILE     Record the game to a replay file (headless: --games 1 only)\n"
+         << "  --replay FILE     Play back a replay at 1x; with --headless, at full speed\n"
+         << "                    --games times over\n"
+         << "  --sessions N      Headless: play N bot games at once, each ticked at\n"
+         << "                    --tick-rate on a shared pool of --threads workers\n"
+         << "  --log-level L     debug, info, warn, error or off (default info; warn for\n"
+         << "                    headless, server and term runs)\n"
+         << "  --respawn N       Collected items come back N ticks later\n"
+         << "  --powerups N      One item in 16 doubles its collector's points for N ticks\n"
+         << "  --input-delay MS  Deliver each move up to MS ms late (headless: up to MS ms\n"
+         << "                    of ticks) and apply it where it was meant by rolling back\n"
+         << "  --shm-input       Also take moves from other processes (see loadgen) through\n"
+         << "                    shared memory; with --headless, only from them\n"
+         << "  --export DIR      With --headless --replay: draw the replay in software at\n"
+         << "                    --fps frames per second of game time into DIR\n"
+         << "  --export-format F png (default) or raw (bare 8-bit RGB, one file per frame)\n";
+}
+
+bool parseOptions(int argc, char* argv[], GameOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--headless") {
+            opts.headless = true;
+        } else if (arg == "--seed" && has_value) {
+            opts.has_seed = true;
+            opts.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--board-size" && has_value) {
+            opts.board_size = atoi(argv[++i]);
+        } else if (arg == "--games" && has_value) {
+            opts.games = atoi(argv[++i]);
+        } else if (arg == "--max-moves" && has_value) {
+            opts.max_moves = atol(argv[++i]);
+        } else if (arg == "--script" && has_value) {
+            opts.script_path = argv[++i];
+        } else if (arg == "--players" && has_value) {
+            opts.players = atoi(argv[++i]);
+        } else if (arg == "--bots") {
+            opts.bots = true;
+        } else if (arg == "--threads" && has_value) {
+            opts.threads = atoi(argv[++i]);
+        } else if (arg == "--repeat-delay" && has_value) {
+            opts.repeat_delay = atoi(argv[++i]);
+        } else if (arg == "--repeat-rate" && has_value) {
+            opts.repeat_rate = atoi(argv[++i]);
+        } else if (arg == "--tick-rate" && has_value) {
+            opts.tick_rate = atoi(argv[++i]);
+        } else if (arg == "--fps" && has_value) {
+            opts.fps = atoi(argv[++i]);
+        } else if (arg == "--stats") {
+            opts.stats = true;
+        } else if (arg == "--stats-json" && has_value) {
+            opts.stats_json = argv[++i];
+        } else if (arg == "--trace" && has_value) {
+            opts.trace_path = argv[++i];
+        } else if (arg == "--server" && has_value) {
+            opts.server_port = atoi(argv[++i]);
+        } else if (arg == "--connect" && has_value) {
+            opts.connect = argv[++i];
+        } else if (arg == "--clients" && has_value) {
+            opts.clients = atoi(argv[++i]);
+        } else if (arg == "--input-rate" && has_value) {
+            opts.input_rate = atoi(argv[++i]);
+        } else if (arg == "--duration" && has_value) {
+            opts.duration = atoi(argv[++i]);
+        } else if (arg == "--renderer" && has_value) {
+            string name = argv[++i];
+            if (name == "sdl") {
+                opts.renderer = RENDERER_SDL;
+            } else if (name == "term") {
+                opts.renderer = RENDERER_TERM;
+            } else if (name == "none") {
+                opts.renderer = RENDERER_NONE;
+            } else {
+                return false;
+            }
+        } else if (arg == "--record" && has_value) {
+            opts.record_path = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            opts.replay_path = argv[++i];
+        } else if (arg == "--sessions" && has_value) {
+            opts.sessions = atoi(argv[++i]);
+        } else if (arg == "--log-level" && has_value) {
+            if (!parseLogLevel(argv[++i], opts.log_level)) {
+                return false;
+            }
+            opts.has_log_level = true;
+        } else if (arg == "--respawn" && has_value) {
+            opts.rules.respawn_ticks = atoi(argv[++i]);
+        } else if (arg == "--powerups" && has_value) {
+            opts.rules.powerup_ticks = atoi(argv[++i]);
+        } else if (arg == "--input-delay" && has_value) {
+            opts.input_delay = atoi(argv[++i]);
+        } else if (arg == "--shm-input") {
+            opts.shm_input = true;
+        } else if (arg == "--export" && has_value) {
+            opts.export_dir = argv[++i];
+        } else if (arg == "--export-format" && has_value) {
+            string name = argv[++i];
+            if (name == "png") {
+                opts.export_format = FRAME_PNG;
+            } else if (name == "raw") {
+                opts.export_format = FRAME_RAW;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
     }
+    if (opts.threads <= 0) {
+        opts.threads = 1;
+    }
+    return opts.board_size >= 0 && opts.board_size <= MAX_BOARD_SIZE && opts.games > 0 && opts.max_moves > 0 && opts.players > 0 &&
+           opts.repeat_delay >= 0 && opts.repeat_rate > 0 && opts.tick_rate > 0 && opts.fps > 0 &&
+           opts.server_port >= 0 && opts.server_port <= 65535 && opts.clients > 0 &&
+           opts.input_rate > 0 && opts.duration > 0 && opts.sessions >= 0 &&
+           opts.rules.respawn_ticks >= 0 && opts.rules.powerup_ticks >= 0 && opts.input_delay >= 0 && (long)opts.input_delay * opts.tick_rate < 1000L * (long)(ROLLBACK_TICKS - 1) &&
+           !(opts.headless && !opts.record_path.empty() && opts.games != 1) &&
+           (opts.export_dir.empty() || (opts.headless && !opts.replay_path.empty()));
 }
 
-// Add this function to check if game is over
-bool isGameOver() {
-    for (const auto& item : game->items) {
-        if (!item.collected) {
+// Parse a move script: whitespace separated moves of the form <player><dir>,
+// e.g. "1R 1R 2U", where player is a player number and dir is one of
+// U, D, L, R. Lines starting with '#' are comments.
+bool loadScript(const string& path, int num_players, vector<GameMessage>& moves) {
+    ifstream in(path.c_str());
+    if (!in) {
+        LOG_ERROR("Failed to open script: {}", path);
+        return false;
+    }
+    string token;
+    while (in >> token) {
+        if (token[0] == '#') {
+            getline(in, token);
+            continue;
+        }
+        const string dirs = "UDLR";
+        size_t dir = dirs.find(token[token.size() - 1]);
+        int player = atoi(token.substr(0, token.size() - 1).c_str());
+        if (player < 1 || player > num_players || dir == string::npos) {
+            LOG_ERROR("Bad move in script: {}", token);
             return false;
         }
+        moves.push_back(makeMove(player - 1, (int)dir));
     }
     return true;
 }
 
-void renderGame() {
-    // Clear screen
-    SDL_SetRenderDrawColor(renderer, BG_COLOR.r, BG_COLOR.g, BG_COLOR.b, 255);
-    SDL_RenderClear(renderer);
-    
-    int CELL_SIZE = SCREEN_SIZE / game->board_size;
-    
-    // Draw grid
-    SDL_SetRenderDrawColor(renderer, GRID_COLOR.r, GRID_COLOR.g, GRID_COLOR.b, 255);
-    for (int i = 0; i <= game->board_size; i++) {
-        SDL_RenderDrawLine(renderer, i * CELL_SIZE, 0, i * CELL_SIZE, SCREEN_SIZE);
-        SDL_RenderDrawLine(renderer, 0, i * CELL_SIZE, SCREEN_SIZE, i * CELL_SIZE);
+// One headless game driven by bots. Each tick every bot is planned in
+// parallel, then the moves are resolved as one batch, so the result
+// doesn't depend on the number of threads. Returns the moves applied.
+long playBotGame(GameBoard& board, long max_moves) {
+    vector<int> ids(board.players.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        ids[i] = (int)i;
     }
+    BotEngine engine(board, ids);
+    botEngine = &engine;
     
-    // Draw items
-    SDL_SetRenderDrawColor(renderer, ITEM_COLOR.r, ITEM_COLOR.g, ITEM_COLOR.b, 255);
-    for (const auto& item : game->items) {
-        if (!item.collected) {
-            SDL_Rect itemRect = {
-                item.x * CELL_SIZE + CELL_PADDING,
-                item.y * CELL_SIZE + CELL_PADDING,
-                CELL_SIZE - 2*CELL_PADDING,
-                CELL_SIZE - 2*CELL_PADDING
-            };
-            SDL_RenderFillRect(renderer, &itemRect);
+    MoveResolver resolver;
+    long moves = 0;
+    for (uint32_t tick = 0; !isGameOver() && moves < max_moves; ++tick) {
+        runTimers(board, tick);
+        engine.sync(board);
+        forEachBotChunk([&engine, &board](size_t first, size_t last) {
+            engine.plan(board, first, last);
+        });
+        long before = moves;
+        for (size_t i = 0; i < engine.size() && moves < max_moves; ++i) {
+            int dir = engine.move(i);
+            if (dir < 0) {
+                continue;
+            }
+            resolver.add(engine.playerId(i), dir);
+            if (recorder) {
+                recorder->record(tick, engine.playerId(i), dir);
+            }
+            moves++;
         }
+        if (moves == before) {
+            break;
+        }
+        resolver.resolve(board, workerPool);
     }
-    
-    // Draw players
-    for (const auto& player : game->players) {
-        if (player.symbol == '1') {
-            SDL_SetRenderDrawColor(renderer, PLAYER1_COLOR.r, PLAYER1_COLOR.g, PLAYER1_COLOR.b, 255);
+    botEngine = nullptr;
+    return moves;
+}
+
+// One headless game of random or scripted input with --input-delay. Move
+// m is made in tick m, as without the delay, but reaches the simulation
+// up to max_delay ticks later and is applied by rolling back. Once the
+// game looks over, every move still in flight is delivered to make sure,
+// so it ends exactly where the undelayed game does. Returns the moves made.
+long playDelayedGame(GameBoard& board, const GameOptions& opts, const vector<GameMessage>& script,
+                     mt19937& input_gen, mt19937& delay_gen, uint64_t& replayed) {
+    uint32_t max_delay = (uint32_t)((long)opts.input_delay * opts.tick_rate / 1000);
+    RollbackSimulation sim(board, ROLLBACK_TICKS);
+    if (recorder) {
+        sim.onFinal(recordTick);
+    }
+    // Moves in flight, by the tick they arrive in
+    typedef vector<pair<uint32_t, GameMessage> > Arrivals;
+    vector<Arrivals> arriving(max_delay + 1);
+    auto deliver = [&sim](Arrivals& moves) {
+        for (const auto& late : moves) {
+            sim.add(late.first, late.second.player_id, directionOf(late.second.dx, late.second.dy));
+        }
+        moves.clear();
+    };
+    long moves = 0;
+    auto more = [&]() {
+        return !isGameOver() && moves < opts.max_moves && (script.empty() || moves < (long)script.size());
+    };
+    for (uint32_t tick = 0; ; ++tick) {
+        sim.catchUp();
+        if (!more()) {
+            for (auto& moves_then : arriving) {
+                deliver(moves_then);
+            }
+            sim.catchUp();
+            if (!more()) {
+                break;
+            }
+        }
+        GameMessage msg;
+        if (!script.empty()) {
+            msg = script[moves];
         } else {
-            SDL_SetRenderDrawColor(renderer, PLAYER2_COLOR.r, PLAYER2_COLOR.g, PLAYER2_COLOR.b, 255);
+            uint32_t bits = input_gen();
+            msg = makeMove((bits >> 2) % opts.players, bits & 3);
         }
-        
-        SDL_Rect playerRect = {
-            player.x * CELL_SIZE + CELL_PADDING,
-            player.y * CELL_SIZE + CELL_PADDING,
-            CELL_SIZE - 2*CELL_PADDING,
-            CELL_SIZE - 2*CELL_PADDING
-        };
-        SDL_RenderFillRect(renderer, &playerRect);
+        uint32_t delay = delay_gen() % (max_delay + 1);
+        arriving[(tick + delay) % arriving.size()].push_back(make_pair(tick, msg));
+        moves++;
+        deliver(arriving[tick % arriving.size()]);
+        sim.advance();
+    }
+    sim.finish();
+    replayed += sim.replayed();
+    return moves;
+}
+
+// Run games back to back without SDL and report throughput. Game g uses
+// board seed (seed + g), so any single game can be reproduced on its own
+// with --seed.
+int runHeadless(const GameOptions& opts) {
+    vector<GameMessage> script;
+    if (!opts.script_path.empty() && !loadScript(opts.script_path, opts.players, script)) {
+        return 1;
     }
     
-    // Draw scores at the top of the window with labels
-    renderScore(10, 10, game->players[0].score, PLAYER1_COLOR);
-    renderScore(SCREEN_SIZE - 110, 10, game->players[1].score, PLAYER2_COLOR);
-    
-    // Check for game over
-    if (isGameOver()) {
-        // Determine winner
-        Player* winner = &game->players[0];
-        if (game->players[1].score > game->players[0].score) {
-            winner = &game->players[1];
-        }
-        
-        // Draw semi-transparent overlay
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 200);
-        SDL_Rect overlay = {0, 0, SCREEN_SIZE, SCREEN_SIZE};
-        SDL_RenderFillRect(renderer, &overlay);
-        
-        // Draw winner announcement box
-        SDL_SetRenderDrawColor(renderer, 
-            winner->symbol == '1' ? PLAYER1_COLOR.r : PLAYER2_COLOR.r,
-            winner->symbol == '1' ? PLAYER1_COLOR.g : PLAYER2_COLOR.g,
-            winner->symbol == '1' ? PLAYER1_COLOR.b : PLAYER2_COLOR.b, 
-            255);
-        
-        // Winner box
-        SDL_Rect winnerBox = {
-            SCREEN_SIZE/4,
-            SCREEN_SIZE/3,
-            SCREEN_SIZE/2,
-            SCREEN_SIZE/3
-        };
-        SDL_RenderFillRect(renderer, &winnerBox);
-        
-        // Draw border for winner box
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        SDL_RenderDrawRect(renderer, &winnerBox);
-        
-        // Draw final scores
-        // Player 1 score
-        renderScore(SCREEN_SIZE/4 + 50, 
-                   SCREEN_SIZE/3 + 30,
-                   game->players[0].score, 
-                   PLAYER1_COLOR);
-               
-        // Player 2 score
-        renderScore(SCREEN_SIZE/4 + 50,
-                   SCREEN_SIZE/3 + 90,
-                   game->players[1].score,
-                   PLAYER2_COLOR);
-        
-        // Draw winner text
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        string winnerText = "Player " + string(1, winner->symbol) + " Wins!";
-        
-        // Draw winner announcement
-        SDL_Rect winnerTextBox = {
-            SCREEN_SIZE/4 + 50,
-            SCREEN_SIZE/3 + 150,
-            SCREEN_SIZE/2 - 100,
-            40
-        };
-        SDL_RenderFillRect(renderer, &winnerTextBox);
-        
-        // Game will automatically close after 5 seconds
-        SDL_RenderPresent(renderer);
-        SDL_Delay(5000);
-        running = false;
+    uint32_t base_seed = opts.has_seed ? opts.seed : random_device()();
+    ReplayWriter writer;
+    // Builds big boards, and runs the bots with --bots
+    ThreadPool pool(opts.threads);
+    if (opts.bots) {
+        workerPool = &pool;
     }
+    long total_moves = 0;
+    uint64_t replayed = 0;
+    int finished = 0;
+    uint64_t checksum = 1469598103934665603ULL;  // FNV-1a over final scores
     
-    SDL_RenderPresent(renderer);
-}
-
-void processMessages() {
-    SDL_Event event;
-    fd_set read_fds;
-    struct timeval tv;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
     
-    while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                running = false;
-                break;
+    for (int g = 0; g < opts.games; ++g) {
+        uint32_t board_seed = base_seed + (uint32_t)g;
+        GameBoard board(board_seed, opts.board_size, opts.players, -1, &pool);
+        board.rules = opts.rules;
+        game = &board;
+        if (!opts.record_path.empty()) {
+            // Random and scripted input has no ticks; every move gets one
+            // of its own
+            ReplayHeader header = {board_seed, (uint32_t)opts.board_size, (uint32_t)opts.players,
+                                   (uint32_t)board.items.size(), (uint32_t)opts.tick_rate,
+                                   (uint32_t)opts.rules.respawn_ticks, (uint32_t)opts.rules.powerup_ticks};
+            if (!writer.open(opts.record_path, header)) {
+                return 1;
             }
+            recorder = &writer;
         }
         
-        FD_ZERO(&read_fds);
-        FD_SET(player1_pipe[0], &read_fds);
-        FD_SET(player2_pipe[0], &read_fds);
-        
-        tv.tv_sec = 0;
-        tv.tv_usec = 16666;  // ~60 FPS
-        
-        int max_fd = max(player1_pipe[0], player2_pipe[0]) + 1;
+        seed_seq input_seed = {board_seed, 0x1u};
+        mt19937 input_gen(input_seed);
+        seed_seq delay_seed = {board_seed, 0x2u};
+        mt19937 delay_gen(delay_seed);
         
-        if (select(max_fd, &read_fds, nullptr, nullptr, &tv) > 0) {
+        long moves = 0;
+        if (opts.bots) {
+            moves = playBotGame(board, opts.max_moves);
+        } else if (opts.input_delay > 0) {
+            moves = playDelayedGame(board, opts, script, input_gen, delay_gen, replayed);
+        }
+        while (!opts.bots && opts.input_delay == 0 && !isGameOver() && moves < opts.max_moves) {
             GameMessage msg;
-            
-            if (FD_ISSET(player1_pipe[0], &read_fds)) {
-                read(player1_pipe[0], &msg, sizeof(GameMessage));
-                if (msg.type == GameMessage::MOVE) {
-                    movePlayer(game->players[0], msg.dx, msg.dy);
+            if (!script.empty()) {
+                if (moves == (long)script.size()) {
+                    break;
                 }
+                msg = script[moves];
+            } else {
+                uint32_t bits = input_gen();
+                msg = makeMove((bits >> 2) % opts.players, bits & 3);
             }
-            
-            if (FD_ISSET(player2_pipe[0], &read_fds)) {
-                read(player2_pipe[0], &msg, sizeof(GameMessage));
-                if (msg.type == GameMessage::MOVE) {
-                    movePlayer(game->players[1], msg.dx, msg.dy);
-                }
+            runTimers(board, (uint32_t)moves);
+            applyMessage(msg);
+            if (recorder) {
+                recorder->record((uint32_t)moves, msg.player_id, directionOf(msg.dx, msg.dy));
             }
+            moves++;
         }
         
-        renderGame();
-        SDL_Delay(16);
+        total_moves += moves;
+        if (isGameOver()) {
+            finished++;
+        }
+        for (const auto& player : board.players) {
+            checksum = (checksum ^ (uint64_t)player.score) * 1099511628211ULL;
+        }
+        game = nullptr;
     }
-}
-
-bool movePlayer(Player& player, int dx, int dy) {
-    int new_x = player.x + dx;
-    int new_y = player.y + dy;
+    workerPool = nullptr;
     
-    // Check if the new position is within bounds
-    if (new_x >= 0 && new_x < game->board_size && 
-        new_y >= 0 && new_y < game->board_size) {
-        player.x = new_x;
-        player.y = new_y;
-        
-        // Check for item collection
-        vector<Item>::iterator item_it;
-        for (item_it = game->items.begin(); item_it != game->items.end(); ++item_it) {
-            if (!item_it->collected && item_it->x == player.x && item_it->y == player.y) {
-                item_it->collected = true;
-                player.score++;
-                player.priority = player.score + 1; // Update priority based on score
-                cout << "Player " << player.symbol << " collected an item! Score: " << player.score << endl;
-                playBeep();  // Play beep sound when collecting item
-                return true;
-            }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    if (recorder) {
+        recorder = nullptr;
+        if (!writer.close()) {
+            LOG_ERROR("Failed to write {}", opts.record_path);
+            return 1;
         }
     }
-    return false;
+    
+    flushLog();
+    cout << "seed: " << base_seed << "\n"
+         << "games: " << opts.games << " (" << finished << " finished)\n"
+         << "moves: " << total_moves << "\n"
+         << "elapsed: " << seconds << " s\n"
+         << "games/s: " << opts.games / seconds << "\n"
+         << "moves/s: " << total_moves / seconds << "\n";
+    if (opts.input_delay > 0 && !opts.bots) {
+        cout << "ticks replayed: " << replayed << "\n";
+    }
+    cout << "checksum: " << hex << checksum << dec << "\n";
+    return 0;
 }
 
-void displayGame() {
-    cout << "\nGame Board:\n";
+// Play --sessions bot games at the same time in this process, each on
+// its own tick schedule, sharing one worker pool. Session s uses board
+// seed (seed + s), so the checksum matches --bots --games with the same
+// count.
+int runSessions(const GameOptions& opts) {
+    uint32_t base_seed = opts.has_seed ? opts.seed : random_device()();
+    ThreadPool pool(opts.threads);
+    SessionScheduler scheduler(pool, opts.tick_rate);
+    
+    vector<unique_ptr<GameSession> > sessions;
+    sessions.reserve(opts.sessions);
+    for (int s = 0; s < opts.sessions; ++s) {
+        sessions.emplace_back(new GameSession(s, base_seed + (uint32_t)s, opts.board_size,
+                                              opts.players, 0, opts.max_moves, opts.rules, &pool));
+    }
     
-    // Create temporary board for display
-    vector<vector<char> > board(game->board_size, 
-                                        vector<char>(game->board_size, '.'));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (auto& session : sessions) {
+        scheduler.add(*session);
+    }
+    scheduler.run(running);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
     
-    // Place items
-    vector<Item>::const_iterator item_it;
-    for (item_it = game->items.begin(); item_it != game->items.end(); ++item_it) {
-        if (!item_it->collected) {
-            board[item_it->y][item_it->x] = '*';
+    long total_moves = 0;
+    uint64_t total_ticks = 0;
+    int finished = 0;
+    uint64_t checksum = 1469598103934665603ULL;
+    for (const auto& session : sessions) {
+        total_moves += session->moves();
+        total_ticks += session->ticks();
+        if (session->board().items_remaining == 0) {
+            finished++;
+        }
+        for (const auto& player : session->board().players) {
+            checksum = (checksum ^ (uint64_t)player.score) * 1099511628211ULL;
         }
     }
+    const LatencyHistogram& late = scheduler.lateness();
     
-    // Place players
-    vector<Player>::const_iterator player_it;
-    for (player_it = game->players.begin(); player_it != game->players.end(); ++player_it) {
-        board[player_it->y][player_it->x] = player_it->symbol;
+    flushLog();
+    cout << "seed: " << base_seed << "\n"
+         << "sessions: " << opts.sessions << " (" << finished << " finished) on "
+         << pool.size() << " threads\n"
+         << "ticks: " << total_ticks << " (" << total_ticks / seconds << "/s)\n"
+         << "moves: " << total_moves << "\n"
+         << "elapsed: " << seconds << " s\n"
+         << "tick lateness p50/p99/max: " << late.percentile(50) / 1000 << " / "
+         << late.percentile(99) / 1000 << " / " << late.max() / 1000 << " us\n"
+         << "checksum: " << hex << checksum << dec << "\n";
+    return 0;
+}
+
+// Re-simulate a replay without rendering, as fast as possible, --games
+// times over. The checksum matches the headless run that recorded it.
+int runReplayHeadless(const GameOptions& opts) {
+    ReplayReader replay;
+    if (!replay.open(opts.replay_path)) {
+        return 1;
+    }
+    const ReplayHeader& header = replay.header();
+    if (replay.truncated()) {
+        LOG_WARN("Replay is truncated; playing the complete ticks");
     }
     
-    // Display the board
-    for (int i = 0; i < game->board_size; ++i) {
-        for (int j = 0; j < game->board_size; ++j) {
-            cout << board[i][j] << " ";
+    ThreadPool pool(opts.threads);  // For building big boards
+    MoveResolver resolver;
+    uint64_t checksum = 1469598103934665603ULL;
+    int finished = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    for (int g = 0; g < opts.games; ++g) {
+        unique_ptr<GameBoard> board(makeReplayBoard(header, &pool));
+        if (!board) {
+            return 1;
+        }
+        game = board.get();
+        vector<Player>& players = board->players;
+        replay.rewind();
+        uint32_t tick = 0;
+        while (replay.nextTick(tick, [&resolver](int player_id, int dir) { resolver.add(player_id, dir); })) {
+            runTimers(*board, tick);
+            resolver.resolve(*board);
+        }
+        if (isGameOver()) {
+            finished++;
         }
-        cout << "\n";
+        for (const auto& player : players) {
+            checksum = (checksum ^ (uint64_t)player.score) * 1099511628211ULL;
+        }
+        game = nullptr;
     }
     
-    // Display scores
-    cout << "\nScores:\n";
-    cout << "Player 1: " << game->players[0].score 
-              << " (Priority: " << game->players[0].priority << ")\n";
-    cout << "Player 2: " << game->players[1].score 
-              << " (Priority: " << game->players[1].priority << ")\n";
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    uint64_t total_moves = replay.moves() * (uint64_t)opts.games;
     
-    // Display controls
-    cout << "\n=== CONTROLS ===\n";
-    cout << "Player 1: WASD keys\n";
-    cout << "Player 2: Arrow keys\n";
-    cout << "Close window to quit\n";
-    cout << "Collect items to score points!\n\n";
+    flushLog();
+    cout << "seed: " << header.seed << "\n"
+         << "ticks: " << replay.ticks() << ", moves: " << replay.moves() << "\n"
+         << "games: " << opts.games << " (" << finished << " finished)\n"
+         << "elapsed: " << seconds << " s\n"
+         << "moves/s: " << total_moves / seconds << "\n"
+         << "checksum: " << hex << checksum << dec << "\n";
+    return 0;
 }
 
-// Update player thread function
-void* playerThread(void* arg) {
-    int player_id = *(int*)arg;
-    int* pipe_write = (player_id == 0) ? &player1_pipe[1] : &player2_pipe[1];
+// Headless --replay with --export: re-simulate the replay tick by tick
+// and draw it with the software renderer at --fps frames per second of
+// game time, ending on the game over screen. Tiles are drawn and frames
+// encoded on a pool of --threads workers, as fast as they go.
+int runExport(const GameOptions& opts) {
+    ReplayReader replay;
+    if (!replay.open(opts.replay_path)) {
+        return 1;
+    }
+    const ReplayHeader& header = replay.header();
+    ThreadPool pool(opts.threads);
+    unique_ptr<GameBoard> board(makeReplayBoard(header, &pool));
+    if (!board) {
+        return 1;
+    }
+    FrameExporter exporter(opts.export_dir, opts.export_format, &pool);
+    if (!exporter.open()) {
+        return 1;
+    }
+    game = board.get();
     
-    while (running) {
-        GameMessage msg;
-        msg.player_id = player_id;
-        
-        // Handle input based on player ID
-        if (player_id == 0) {  // Player 1 (WASD)
-            const Uint8* keyState = SDL_GetKeyboardState(NULL);
-            if (keyState[SDL_SCANCODE_W]) { msg.dx = 0; msg.dy = -1; }
-            else if (keyState[SDL_SCANCODE_S]) { msg.dx = 0; msg.dy = 1; }
-            else if (keyState[SDL_SCANCODE_A]) { msg.dx = -1; msg.dy = 0; }
-            else if (keyState[SDL_SCANCODE_D]) { msg.dx = 1; msg.dy = 0; }
-            else continue;
-        }
-        else {  // Player 2 (Arrow Keys)
-            const Uint8* keyState = SDL_GetKeyboardState(NULL);
-            if (keyState[SDL_SCANCODE_UP]) { msg.dx = 0; msg.dy = -1; }
-            else if (keyState[SDL_SCANCODE_DOWN]) { msg.dx = 0; msg.dy = 1; }
-            else if (keyState[SDL_SCANCODE_LEFT]) { msg.dx = -1; msg.dy = 0; }
-            else if (keyState[SDL_SCANCODE_RIGHT]) { msg.dx = 1; msg.dy = 0; }
-            else continue;
+    SoftwareRenderer painter;
+    SnapshotBuffer buffer;
+    GameSnapshot snapshot;
+    vector<InputStamp> none;
+    auto drawFrame = [&](bool gameOver) {
+        buffer.publish(*board, none);
+        buffer.acquire(snapshot);
+        painter.draw(snapshot, gameOver, &pool);
+        exporter.write(painter.pixels(), painter.size(), painter.size());
+    };
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MoveResolver moves;  // The next tick group, until its tick comes up
+    auto hold = [&moves](int player_id, int dir) { moves.add(player_id, dir); };
+    uint32_t group_tick = 0;
+    bool more = replay.nextTick(group_tick, hold);
+    uint64_t tick_rate = header.tick_rate > 0 ? header.tick_rate : 60;
+    uint64_t frames = 0;
+    uint32_t ticks = 0;
+    drawFrame(false);
+    frames++;
+    for (; running && more; ++ticks) {
+        runTimers(*board, ticks);
+        while (more && group_tick == ticks) {
+            moves.resolve(*board);
+            more = replay.nextTick(group_tick, hold);
+        }
+        // Every frame due by the end of this tick
+        for (; frames * tick_rate <= (uint64_t)(ticks + 1) * opts.fps; ++frames) {
+            drawFrame(false);
         }
-        
-        msg.type = GameMessage::MOVE;
-        write(*pipe_write, &msg, sizeof(GameMessage));
-        SDL_Delay(16);  // Prevent too frequent updates
     }
+    if (isGameOver()) {
+        drawFrame(true);
+        frames++;
+    }
+    bool written = exporter.finish();
+    game = nullptr;
     
-    return nullptr;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    flushLog();
+    cout << "seed: " << header.seed << "\n"
+         << "ticks: " << ticks << " (" << ticks / (double)tick_rate << " s of game time)\n"
+         << "frames: " << frames << " (" << exporter.bytesWritten() / max<uint64_t>(1, frames)
+         << " bytes each) in " << opts.export_dir << "\n"
+         << "elapsed: " << seconds << " s on " << pool.size() << " threads\n"
+         << "frames/s: " << frames / seconds << " (" << ticks / (double)tick_rate / seconds
+         << "x real time)\n";
+    return written ? 0 : 1;
 }
 
-// Audio constants
-const int SAMPLE_RATE = 44100;
-const int AMPLITUDE = 28000;
-const float FREQUENCY = 800.0f;  // Frequency in Hz for the beep
-SDL_AudioDeviceID audioDevice;
-
-// Audio callback function
-void audioCallback(void* userdata, Uint8* stream, int len) {
-    static double phase = 0.0;
-    Sint16* buffer = (Sint16*)stream;
-    int length = len / 2;  // Since we're using Sint16 (2 bytes)
+// Headless --shm-input: a game fed only by other processes (e.g.
+// loadgen) through shared memory. Each tick applies everything queued
+// since the last one, so ticks run back to back under load and sleep on
+// the futex when nobody is sending. Stops after --duration seconds, at
+// SIGINT or when the game is over.
+int runShmSink(const GameOptions& opts) {
+    uint32_t seed = opts.has_seed ? opts.seed : random_device()();
+    ThreadPool pool(opts.threads);  // For building big boards
+    GameBoard board(seed, opts.board_size, opts.players, -1, &pool);
+    board.rules = opts.rules;
+    game = &board;
+    ShmInputRing ring;
+    if (!ring.create(opts.players)) {
+        LOG_ERROR("Failed to create shared input memory");
+        return 1;
+    }
+    cout << "Listening for moves at " << ring.path() << "\n"
+         << "  e.g. ./loadgen " << ring.path() << " --processes 4\n" << flush;
     
-    for(int i = 0; i < length; i++) {
-        buffer[i] = (Sint16)(AMPLITUDE * sin(phase));
-        phase += 2.0 * M_PI * FREQUENCY / SAMPLE_RATE;
-        if(phase > 2.0 * M_PI) {
-            phase -= 2.0 * M_PI;
+    MoveResolver resolver;
+    LatencyHistogram latency;   // Created in the producer -> applied here
+    uint64_t moves = 0;
+    uint64_t rejected = 0;
+    uint32_t tick = 0;
+    uint64_t start_ns = nowNs();
+    uint64_t end_ns = start_ns + (uint64_t)opts.duration * 1000000000ULL;
+    vector<uint64_t> created;
+    while (running && !isGameOver() && nowNs() < end_ns) {
+        ring.wait(100);
+        ring.drain([&](const ShmMove& move) {
+            if (move.player_id < 0 || move.player_id >= opts.players || move.dir < 0 || move.dir >= 4) {
+                rejected++;
+                return;
+            }
+            resolver.add(move.player_id, move.dir);
+            created.push_back(move.created_ns);
+        });
+        if (created.empty()) {
+            continue;
         }
+        runTimers(board, tick++);
+        resolver.resolve(board);
+        uint64_t applied_ns = nowNs();
+        for (uint64_t created_ns : created) {
+            latency.record(applied_ns - min(created_ns, applied_ns));
+        }
+        moves += created.size();
+        created.clear();
     }
+    double seconds = (nowNs() - start_ns) / 1e9;
+    
+    uint64_t checksum = 1469598103934665603ULL;
+    for (const auto& player : board.players) {
+        checksum = (checksum ^ (uint64_t)player.score) * 1099511628211ULL;
+    }
+    game = nullptr;
+    
+    flushLog();
+    cout << "seed: " << seed << "\n"
+         << "ticks: " << tick << ", moves: " << moves << "\n"
+         << "rejected: " << rejected + ring.discarded() << "\n"
+         << "elapsed: " << seconds << " s\n"
+         << "moves/s: " << moves / seconds << "\n"
+         << "input latency p50/p99/max: " << latency.percentile(50) / 1000 << " / "
+         << latency.percentile(99) / 1000 << " / " << latency.max() / 1000 << " us\n"
+         << "checksum: " << hex << checksum << dec << "\n";
+    return 0;
 }
 
-// Function to play beep sound
-void playBeep() {
-    SDL_PauseAudioDevice(audioDevice, 0);  // Start playing
-    SDL_Delay(100);  // Play for 100ms
-    SDL_PauseAudioDevice(audioDevice, 1);  // Stop playing
-}
-
-int main() {
+// Open the window, renderer and audio device for the SDL front end
+bool startSdl() {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
-        cerr << "SDL initialization failed: " << SDL_GetError() << endl;
-        return 1;
+        LOG_ERROR("SDL initialization failed: {}", SDL_GetError());
+        return false;
     }
     
     // Initialize audio
-    SDL_AudioSpec want, have;
-    SDL_zero(want);
-    want.freq = SAMPLE_RATE;
-    want.format = AUDIO_S16SYS;
-    want.channels = 1;
-    want.samples = 2048;
-    want.callback = audioCallback;
-    
-    audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
-    if (audioDevice == 0) {
-        cerr << "Failed to open audio device: " << SDL_GetError() << endl;
-        return 1;
+    if (!mixer.open(SAMPLE_RATE)) {
+        LOG_ERROR("Failed to open audio device: {}", SDL_GetError());
+        return false;
     }
+    onCollect = playBeep;
     
     window = SDL_CreateWindow("Multiplayer Collection Game",
                             SDL_WINDOWPOS_UNDEFINED,
@@ -579,60 +1360,256 @@ int main() {
                             SCREEN_SIZE,
                             SDL_WINDOW_SHOWN);
     if (!window) {
-        cerr << "Window creation failed: " << SDL_GetError() << endl;
-        return 1;
+        LOG_ERROR("Window creation failed: {}", SDL_GetError());
+        return false;
     }
     
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (!renderer) {
-        cerr << "Renderer creation failed: " << SDL_GetError() << endl;
+        LOG_ERROR("Renderer creation failed: {}", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+// Undo startSdl, if it ran
+void stopSdl() {
+    if (rendererKind != RENDERER_SDL) {
+        return;
+    }
+    onCollect = nullptr;
+    mixer.close();
+    invalidateRenderCache();
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+void handleSignal(int) {
+    running = false;
+}
+
+int main(int argc, char* argv[]) {
+    GameOptions opts;
+    if (!parseOptions(argc, argv, opts)) {
+        printUsage(argv[0]);
         return 1;
     }
-   
-    game = new GameBoard();
+    
+    // Per-collection messages would bury a headless run's summary and
+    // scribble over the terminal front end
+    bool quiet = opts.headless || opts.server_port > 0 || opts.renderer == RENDERER_TERM;
+    setLogLevel(opts.has_log_level ? opts.log_level : quiet ? LOG_LEVEL_WARN : LOG_LEVEL_INFO);
+    
+    TRACE_THREAD("main");
+    if (!opts.trace_path.empty()) {
+        tracePath = opts.trace_path;
+        startTracing();
+        atexit(writeTraceFile);
+    }
+    
+    if (opts.server_port > 0) {
+        signal(SIGINT, handleSignal);
+        signal(SIGTERM, handleSignal);
+        ServerOptions server_opts = {(uint16_t)opts.server_port,
+                                     opts.has_seed ? opts.seed : random_device()(),
+                                     opts.board_size, opts.players, opts.tick_rate, opts.rules};
+        return runServer(server_opts, running);
+    }
+    
+    if (opts.headless && !opts.connect.empty()) {
+        signal(SIGINT, handleSignal);
+        signal(SIGTERM, handleSignal);
+        LoadClientOptions load_opts = {opts.connect, opts.clients, opts.input_rate, opts.duration,
+                                       opts.has_seed ? opts.seed : random_device()()};
+        return runLoadClients(load_opts, running);
+    }
+    
+    if (opts.headless && !opts.replay_path.empty()) {
+        return opts.export_dir.empty() ? runReplayHeadless(opts) : runExport(opts);
+    }
+    
+    if (opts.headless && opts.sessions > 0) {
+        signal(SIGINT, handleSignal);
+        signal(SIGTERM, handleSignal);
+        return runSessions(opts);
+    }
+    
+    if (opts.headless && opts.shm_input) {
+        signal(SIGINT, handleSignal);
+        signal(SIGTERM, handleSignal);
+        return runShmSink(opts);
+    }
+    
+    if (opts.headless) {
+        return runHeadless(opts);
+    }
+    
+    rendererKind = opts.renderer;
+    if (rendererKind == RENDERER_SDL) {
+        if (!startSdl()) {
+            return 1;
+        }
+    } else {
+        // The terminal front end owns stdout, and nothing else can end the game
+        signal(SIGINT, handleSignal);
+        signal(SIGTERM, handleSignal);
+    }
+    
+    repeatDelay = opts.repeat_delay;
+    repeatInterval = max(1, 1000 / opts.repeat_rate);
+    tickRate = opts.tick_rate;
+    inputDelayMs = opts.input_delay;
+    frameRate = opts.fps;
+    statsOverlay.visible = opts.stats;
+    uint64_t start_ns = nowNs();
+    
+    // Builds big boards and runs the bots
+    workerPool = new ThreadPool(opts.threads);
+    
+    if (!opts.connect.empty()) {
+        // The server owns the game; this front end mirrors it and sends the
+        // WASD player's moves
+        ClientGame remote;
+        server = new ServerConnection();
+        if (!server->connect(opts.connect) || !server->waitForWelcome(remote, 5000)) {
+            return 1;
+        }
+        game = remote.board.get();
+        if (remote.player_id != NET_NO_PLAYER) {
+            cout << "Joined " << opts.connect << " as player " << remote.player_id + 1
+                 << " (WASD keys)\n\n";
+            KeyboardPlayer kp = {(int)remote.player_id, 0, {false, false, false, false}, -1, 0};
+            keyboardPlayers.push_back(kp);
+            snapshots.follow((int)remote.player_id);
+        } else {
+            cout << "Joined " << opts.connect << " as a spectator (every slot is taken)\n\n";
+        }
+        
+        publishFirstSnapshot();
+        thread network(runNetworkClient, ref(remote));
+        runFrontEnd();
+        running = false;
+        network.join();
+        
+        if (!opts.stats_json.empty() &&
+            !writeMetricsJson(opts.stats_json, metrics, (nowNs() - start_ns) / 1e9, 0)) {
+            LOG_ERROR("Failed to write {}", opts.stats_json);
+        }
+        
+        delete server;
+        server = nullptr;
+        game = nullptr;
+        delete workerPool;
+        stopSdl();
+        return 0;
+    }
+    
+    if (!opts.replay_path.empty()) {
+        ReplayReader replay;
+        if (!replay.open(opts.replay_path) || !(game = makeReplayBoard(replay.header(), workerPool))) {
+            return 1;
+        }
+        cout << "Replaying " << opts.replay_path << ": " << replay.moves() << " moves over "
+             << replay.ticks() << " ticks\n\n";
+        tickRate = (int)replay.header().tick_rate;
+        
+        publishFirstSnapshot();
+        thread playback(runReplay, ref(replay));
+        runFrontEnd();
+        running = false;
+        playback.join();
+        
+        delete game;
+        delete workerPool;
+        stopSdl();
+        return 0;
+    }
+    
+    uint32_t seed = opts.has_seed ? opts.seed : random_device()();
+    game = new GameBoard(seed, opts.board_size, opts.players, -1, workerPool);
+    game->rules = opts.rules;
+    
+    if (!opts.record_path.empty()) {
+        ReplayHeader header = {seed, (uint32_t)opts.board_size, (uint32_t)opts.players,
+                               (uint32_t)game->items.size(), (uint32_t)tickRate,
+                               (uint32_t)opts.rules.respawn_ticks, (uint32_t)opts.rules.powerup_ticks};
+        recorder = new ReplayWriter();
+        if (!recorder->open(opts.record_path, header)) {
+            return 1;
+        }
+    }
     
     cout << "Welcome to Multiplayer Collection Game!\n";
     cout << "Player 1: WASD keys\n";
     cout << "Player 2: Arrow keys\n";
-    cout << "Close window to quit\n";
+    cout << (rendererKind == RENDERER_SDL ? "Close window to quit\n" : "Press q to quit\n");
     cout << "Collect items to score points!\n\n";
     
-    // Create pipes for message passing
-    if (pipe(player1_pipe) < 0 || pipe(player2_pipe) < 0) {
-        cerr << "Failed to create pipes" << endl;
+    // One input lane per pool worker, plus one for the main thread's keyboard
+    // input and one for the simulation thread's share of the bots
+    int keyboard_players = rendererKind == RENDERER_NONE || opts.bots ? 0 : min(opts.players, NUM_KEYBOARD_PLAYERS);
+    inputQueue = new InputQueue(workerPool->size() + 2);
+    keyboardLane = workerPool->size();
+    simulationLane = workerPool->size() + 1;
+    if (!inputQueue->valid()) {
+        LOG_ERROR("Failed to create input queue");
         return 1;
     }
     
-    // Set pipes to non-blocking mode
-    fcntl(player1_pipe[0], F_SETFL, O_NONBLOCK);
-    fcntl(player2_pipe[0], F_SETFL, O_NONBLOCK);
-    
-    // Create player threads
-    pthread_t thread1, thread2;
-    int player1_id = 0, player2_id = 1;
+    if (opts.shm_input) {
+        shmInput = new ShmInputRing();
+        if (!shmInput->create(opts.players)) {
+            LOG_ERROR("Failed to create shared input memory");
+            return 1;
+        }
+        cout << "Other processes can send moves through " << shmInput->path() << "\n" << endl;
+    }
     
-    pthread_create(&thread1, nullptr, playerThread, &player1_id);
-    pthread_create(&thread2, nullptr, playerThread, &player2_id);
+    vector<int> bot_players;
+    for (int i = keyboard_players; i < opts.players; ++i) {
+        bot_players.push_back(i);
+    }
+    botEngine = new BotEngine(*game, bot_players);
+    if (!bot_players.empty()) {
+        cout << bot_players.size() << " bot players on " << workerPool->size() << " worker threads\n\n";
+    }
     
-    // Main game loop
-    processMessages();
+    for (int i = 0; i < keyboard_players; ++i) {
+        KeyboardPlayer kp = {i, i, {false, false, false, false}, -1, 0};
+        keyboardPlayers.push_back(kp);
+    }
     
-    // Cleanup
-    pthread_join(thread1, nullptr);
-    pthread_join(thread2, nullptr);
+    // Simulation runs on its own thread at a fixed tick; the main thread
+    // handles events and rendering
+    publishFirstSnapshot();
+    thread simulation(runSimulation);
+    runFrontEnd();
+    running = false;
+    simulation.join();
     
-    close(player1_pipe[0]);
-    close(player1_pipe[1]);
-    close(player2_pipe[0]);
-    close(player2_pipe[1]);
+    if (recorder) {
+        if (recorder->close()) {
+            cout << "Recorded " << recorder->movesRecorded() << " moves to " << opts.record_path << endl;
+        } else {
+            LOG_ERROR("Failed to write {}", opts.record_path);
+        }
+        delete recorder;
+        recorder = nullptr;
+    }
     
-    // Add cleanup for audio before SDL_Quit()
-    SDL_CloseAudioDevice(audioDevice);
+    if (!opts.stats_json.empty() &&
+        !writeMetricsJson(opts.stats_json, metrics, (nowNs() - start_ns) / 1e9, droppedInputs())) {
+        LOG_ERROR("Failed to write {}", opts.stats_json);
+    }
     
+    // Cleanup
+    delete workerPool;
+    delete inputQueue;
+    delete shmInput;
+    delete botEngine;
     delete game;
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    stopSdl();
     
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,413 @@
+#include "game_board.h"
+
+#include <algorithm>
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+
+using namespace std;
+
+GameBoard* game = nullptr;
+void (*onCollect)() = nullptr;
+
+namespace {
+// Call f(first, last) on slices of [0, n): with a pool, one per worker
+// plus one for the calling thread, all run through parallelFor
+template <typename F>
+void forEachSlice(ThreadPool* pool, int n, F f) {
+    int slices = pool ? max(1, min(n, (int)pool->size() + 1)) : 1;
+    if (slices == 1) {
+        f(0, n);
+        return;
+    }
+    pool->parallelFor((size_t)slices, [n, slices, &f](size_t s) {
+        f((int)((long)n * s / slices), (int)((long)n * (s + 1) / slices));
+    });
+}
+}
+
+// Symbols for players 1, 2, ...
+const string PLAYER_SYMBOLS = "123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+char playerSymbol(int index) {
+    return PLAYER_SYMBOLS[index % PLAYER_SYMBOLS.size()];
+}
+
+GameMessage makeMove(int player_id, int dir) {
+    GameMessage msg;
+    msg.type = GameMessage::MOVE;
+    msg.player_id = player_id;
+    msg.dx = DIR_DX[dir];
+    msg.dy = DIR_DY[dir];
+    msg.item_index = -1;
+    msg.created_ns = nowNs();
+    msg.dequeued_ns = 0;
+    return msg;
+}
+
+GameBoard::GameBoard(uint32_t seed, int size, int num_players, int num_items, ThreadPool* pool) : restocks(0), tick(0), replaying(false), version(0), gen(seed), board_seed(seed) {
+    if (size > 0) {
+        board_size = size;
+    } else {
+        calculateBoardSize();
+    }
+    initializePlayers(num_players);
+    initializeItems(num_items < 0 ? board_size * 2 : num_items, pool);
+}
+
+void GameBoard::calculateBoardSize() {
+    uniform_int_distribution<> dis(10, 99);
+
+    int random_num = dis(gen);
+    int calc_1 = random_num * 3;
+    int board_size_calc = calc_1 % 25;
+
+    if (board_size_calc < 10) {
+        board_size_calc += 15;
+    }
+
+    board_size = board_size_calc;
+}
+
+void GameBoard::initializePlayers(int num_players) {
+    players.reserve(num_players);
+    players.emplace_back(0, 0, '1', 1);  // Player 1 with priority 1
+    if (num_players > 1) {
+        players.emplace_back(board_size-1, board_size-1, '2', 1);  // Player 2 with priority 1
+    }
+
+    // Everyone else starts on a random cell
+    uniform_int_distribution<> dis(0, board_size-1);
+    for (int i = 2; i < num_players; ++i) {
+        int x = dis(gen);
+        int y = dis(gen);
+        players.emplace_back(x, y, playerSymbol(i), 1);
+    }
+}
+
+void GameBoard::initializeItems(int num_items, ThreadPool* pool) {
+    TRACE_ZONE("place_items");
+    items.resize(num_items);
+    items_remaining = num_items;
+    uint64_t seed = gen();
+    if (num_items < PARALLEL_MIN_ITEMS) {
+        pool = nullptr;
+    }
+    int bands = bandCount();
+    if ((long)board_size * board_size <= DENSE_INDEX_MAX_CELLS) {
+        forEachSlice(pool, bands, [this, num_items, seed](int first, int last) {
+            TRACE_ZONE("fill_bands");
+            for (int band = first; band < last; ++band) {
+                fillBand(band, num_items, seed);
+            }
+        });
+        buildDenseIndex();
+        return;
+    }
+
+    // Fill and sort each band, counting its chunks, then cut every band
+    // into its chunks' ranges in one preallocated array
+    chunk_items.resize(num_items);
+    vector<int> first_chunk(bands + 1, 0);
+    forEachSlice(pool, bands, [this, num_items, seed, &first_chunk](int first, int last) {
+        TRACE_ZONE("fill_bands");
+        vector<uint64_t> keyed;
+        vector<int> buckets;
+        for (int band = first; band < last; ++band) {
+            fillBand(band, num_items, seed);
+            first_chunk[band + 1] = sortBandByChunk(band, num_items, keyed, buckets);
+        }
+    });
+    for (int band = 0; band < bands; ++band) {
+        first_chunk[band + 1] += first_chunk[band];
+    }
+    chunk_keys.resize(first_chunk[bands]);
+    chunk_ranges.resize(first_chunk[bands]);
+    forEachSlice(pool, bands, [this, num_items, &first_chunk](int first, int last) {
+        TRACE_ZONE("index_bands");
+        for (int band = first; band < last; ++band) {
+            indexBandChunks(band, num_items, first_chunk[band]);
+        }
+    });
+}
+
+int GameBoard::bandStart(int band, int num_items) const {
+    long rows = min((long)band * CHUNK_SIZE, (long)board_size);
+    return (int)((int64_t)num_items * rows / board_size);
+}
+
+void GameBoard::fillBand(int band, int num_items, uint64_t seed) {
+    SplitMix64 rng(SplitMix64::mix(seed + (uint64_t)band));
+    uint32_t top = (uint32_t)band * CHUNK_SIZE;
+    uint32_t rows = (uint32_t)min(CHUNK_SIZE, board_size - (int)top);
+    int end = bandStart(band + 1, num_items);
+    for (int i = bandStart(band, num_items); i < end; ++i) {
+        uint32_t x = rng.below((uint32_t)board_size);
+        uint32_t y = top + rng.below(rows);
+        items.set(i, x, y);
+    }
+}
+
+int GameBoard::sortBandByChunk(int band, int num_items, vector<uint64_t>& keyed, vector<int>& buckets) {
+    // Key and index pack into one integer. Every key in a band is above
+    // those of the bands before it, so the bands sorted one by one are
+    // sorted as a whole.
+    int first = bandStart(band, num_items);
+    int n = bandStart(band + 1, num_items) - first;
+    if (n == 0) {
+        return 0;
+    }
+
+    // Bucket by x first; items are uniform, so that's about one per
+    // bucket and leaves only neighbours for an insertion sort to swap
+    buckets.assign(n + 1, 0);
+    for (int i = first; i < first + n; ++i) {
+        buckets[(uint64_t)items.x(i) * n / board_size + 1]++;
+    }
+    for (int b = 0; b < n; ++b) {
+        buckets[b + 1] += buckets[b];
+    }
+    keyed.resize(n);
+    for (int i = first; i < first + n; ++i) {
+        uint64_t key = ((uint64_t)chunkKey(items.x(i), items.y(i)) << 32) | (uint32_t)i;
+        keyed[buckets[(uint64_t)items.x(i) * n / board_size]++] = key;
+    }
+    for (int k = 1; k < n; ++k) {
+        uint64_t key = keyed[k];
+        int j = k;
+        for (; j > 0 && keyed[j - 1] > key; --j) {
+            keyed[j] = keyed[j - 1];
+        }
+        keyed[j] = key;
+    }
+
+    int chunks = 1;
+    chunk_items[first] = (int)(uint32_t)keyed[0];
+    for (int k = 1; k < n; ++k) {
+        chunk_items[first + k] = (int)(uint32_t)keyed[k];
+        chunks += (keyed[k] >> 32) != (keyed[k - 1] >> 32);
+    }
+    return chunks;
+}
+
+void GameBoard::indexBandChunks(int band, int num_items, int chunk) {
+    int first = bandStart(band, num_items);
+    int end = bandStart(band + 1, num_items);
+    for (int k = first; k < end; ++k) {
+        int i = chunk_items[k];
+        uint32_t key = chunkKey(items.x(i), items.y(i));
+        if (k == first || chunk_keys[chunk - 1] != key) {
+            ChunkRange range = {k, 0};
+            chunk_keys[chunk] = key;
+            chunk_ranges[chunk++] = range;
+        }
+        chunk_ranges[chunk - 1].count++;
+    }
+}
+
+void GameBoard::buildDenseIndex() {
+    cell_items.assign(board_size * board_size, -1);
+    next_item.resize(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        int cell = cellIndex(items.x(i), items.y(i));
+        next_item[i] = cell_items[cell];
+        cell_items[cell] = (int)i;
+    }
+}
+
+bool GameBoard::removeItem(int i) {
+    if (items.isCollected(i)) {
+        return false;
+    }
+    items.markCollected(i);
+    items_remaining--;
+    version++;
+    return true;
+}
+
+bool GameBoard::restoreItem(int i) {
+    if (!items.isCollected(i)) {
+        return false;
+    }
+    items.uncollect(i);
+    items_remaining++;
+    restocks++;
+    version++;
+    return true;
+}
+
+int GameBoard::collectFromChunk(int x, int y) {
+    const ChunkRange* range = findChunk(x, y);
+    if (!range) {
+        return 0;
+    }
+    int count = 0;
+    for (int k = range->start; k < range->start + range->count; ++k) {
+        int i = chunk_items[k];
+        if ((int)items.x(i) == x && (int)items.y(i) == y && !items.isCollected(i)) {
+            items.markCollected(i);
+            collected_now.push_back((uint32_t)i);
+            count++;
+        }
+    }
+    items_remaining -= count;
+    return count;
+}
+
+bool movePlayer(GameBoard& board, Player& player, int dx, int dy) {
+    int new_x = player.x + dx;
+    int new_y = player.y + dy;
+
+    // Check if the new position is within bounds
+    if (new_x >= 0 && new_x < board.board_size &&
+        new_y >= 0 && new_y < board.board_size) {
+        player.x = new_x;
+        player.y = new_y;
+        board.version++;
+        return collectUnder(board, player);
+    }
+    return false;
+}
+
+namespace {
+// Score the collected items in board.collected_now for player and, under
+// the board's rules, schedule their respawns and start power-ups
+bool award(GameBoard& board, Player& player, int collected) {
+    if (collected == 0) {
+        return false;
+    }
+    player.score += collected * player.multiplier;
+    player.priority = player.score + 1; // Update priority based on score
+    if (board.rules.respawn_ticks > 0 || board.rules.powerup_ticks > 0) {
+        uint32_t player_id = (uint32_t)(&player - &board.players[0]);
+        for (uint32_t i : board.collected_now) {
+            if (board.rules.respawn_ticks > 0) {
+                board.timers.schedule(board.tick + board.rules.respawn_ticks, TIMER_RESPAWN, i);
+            }
+            if (board.isPowerUp(i)) {
+                // A newer power-up extends the boost; the older timer then
+                // finds boost_end moved on and leaves it alone
+                player.multiplier = 2;
+                player.boost_end = board.tick + board.rules.powerup_ticks;
+                board.timers.schedule(player.boost_end, TIMER_BOOST_END, player_id);
+            }
+        }
+    }
+    if (board.replaying) {
+        return true;
+    }
+    LOG_INFO("Player {} collected an item! Score: {}", player.symbol, player.score);
+    if (onCollect) {
+        onCollect();
+    }
+    return true;
+}
+}
+
+bool collectUnder(GameBoard& board, Player& player) {
+    // Stacked items are all picked up at once
+    return award(board, player, board.collectItemsAt(player.x, player.y));
+}
+
+void collectUnderEach(GameBoard& board, const vector<int>& player_ids) {
+    ItemStore& items = board.items;
+    if (player_ids.empty() || items.size() * player_ids.size() > GameBoard::SCAN_MAX_PAIRS) {
+        for (int id : player_ids) {
+            collectUnder(board, board.players[id]);
+        }
+        return;
+    }
+
+    board.scan_x.clear();
+    board.scan_y.clear();
+    for (int id : player_ids) {
+        board.scan_x.push_back((uint32_t)board.players[id].x);
+        board.scan_y.push_back((uint32_t)board.players[id].y);
+    }
+    vector<uint64_t>& hits = board.scan_hits;
+    hits.assign(items.wordCount(), 0);
+    matchCells(items.xData(), items.yData(), items.size(), &board.scan_x[0], &board.scan_y[0],
+               player_ids.size(), &hits[0]);
+
+    // Then each player, in order, takes the matched items on its cell
+    const uint64_t* collected = items.collectedData();
+    for (size_t p = 0; p < player_ids.size(); ++p) {
+        board.collected_now.clear();
+        for (size_t w = 0; w < hits.size(); ++w) {
+            for (uint64_t bits = hits[w] & ~collected[w]; bits; bits &= bits - 1) {
+                size_t i = w * 64 + (size_t)__builtin_ctzll(bits);
+                if (items.x(i) == board.scan_x[p] && items.y(i) == board.scan_y[p]) {
+                    items.markCollected(i);
+                    board.collected_now.push_back((uint32_t)i);
+                }
+            }
+        }
+        int count = (int)board.collected_now.size();
+        board.items_remaining -= count;
+        award(board, board.players[player_ids[p]], count);
+    }
+}
+
+void runTimers(GameBoard& board, uint32_t tick) {
+    board.tick = tick;
+    vector<Timer>& due = board.due_timers;
+    board.timers.expire(tick, due);
+    for (const auto& timer : due) {
+        if (timer.kind == TIMER_RESPAWN) {
+            board.restoreItem((int)timer.arg);
+        } else if (timer.kind == TIMER_BOOST_END) {
+            Player& player = board.players[timer.arg];
+            if (player.boost_end == timer.deadline) {
+                player.multiplier = 1;
+                board.version++;
+            }
+        }
+    }
+    due.clear();
+}
+
+void undoTimers(GameBoard& board, const vector<TimerOp>& ops) {
+    for (size_t k = ops.size(); k-- > 0;) {
+        const TimerOp& op = ops[k];
+        if (!op.added && op.timer.kind == TIMER_RESPAWN) {
+            board.removeItem((int)op.timer.arg);
+        }
+        board.timers.undo(op);
+    }
+}
+
+void applyMessage(GameBoard& board, const GameMessage& msg) {
+    if (msg.type == GameMessage::MOVE &&
+        msg.player_id >= 0 && msg.player_id < (int)board.players.size()) {
+        movePlayer(board, board.players[msg.player_id], msg.dx, msg.dy);
+    }
+}
+
+bool movePlayer(Player& player, int dx, int dy) {
+    return movePlayer(*game, player, dx, dy);
+}
+
+void applyMessage(const GameMessage& msg) {
+    applyMessage(*game, msg);
+}
+
+// Add this function to check if game is over
+bool isGameOver() {
+    return game->items_remaining == 0;
+}
+
+vector<int> leadingPlayers(const vector<Player>& players, size_t max_count) {
+    vector<int> order(players.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = (int)i;
+    }
+    max_count = min(max_count, order.size());
+    partial_sort(order.begin(), order.begin() + max_count, order.end(), [&players](int a, int b) {
+        if (players[a].score != players[b].score) {
+            return players[a].score > players[b].score;
+        }
+        return a < b;
+    });
+    order.resize(max_count);
+    return order;
+}
@@ -0,0 +1,352 @@
+#ifndef GAME_BOARD_H
+#define GAME_BOARD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "item_store.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+
+// Message structure for thread communication
+struct GameMessage {
+    enum Type { MOVE, COLLECT, QUIT } type;
+    int player_id;
+    int dx;
+    int dy;
+    int item_index;
+    uint64_t created_ns;   // When the input was generated
+    uint64_t dequeued_ns;  // When the simulation picked it up
+};
+
+// Direction codes used by key maps, scripts and bots: up, down, left, right
+const int DIR_DX[4] = {0, 0, -1, 1};
+const int DIR_DY[4] = {-1, 1, 0, 0};
+
+GameMessage makeMove(int player_id, int dir);
+
+// Direction code of a one-cell step, or -1 if (dx, dy) isn't one
+inline int directionOf(int dx, int dy) {
+    for (int dir = 0; dir < 4; ++dir) {
+        if (DIR_DX[dir] == dx && DIR_DY[dir] == dy) {
+            return dir;
+        }
+    }
+    return -1;
+}
+
+// Symbol for player index (0 is player 1); reused if there are more
+// players than symbols
+char playerSymbol(int index);
+
+// SplitMix64: a small, fast generator whose output is a good seed for
+// another one. Works with the <random> distributions.
+class SplitMix64 {
+public:
+    typedef uint64_t result_type;
+
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return ~0ULL; }
+
+    uint64_t operator()() { return mix(state += 0x9E3779B97F4A7C15ULL); }
+
+    // Uniform in [0, n), by multiply-shift instead of division
+    uint32_t below(uint32_t n) { return (uint32_t)(((*this)() >> 32) * n >> 32); }
+
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    uint64_t state;
+};
+
+struct Player {
+    int x, y;
+    int score;
+    char symbol;
+    int priority;
+    int multiplier;      // Points per item; 2 while a power-up lasts
+    uint32_t boost_end;  // Tick the current power-up runs out in
+
+    Player(int startX, int startY, char sym, int prio) :
+        x(startX), y(startY), score(0), symbol(sym), priority(prio), multiplier(1), boost_end(0) {}
+};
+
+// Optional rules for long games; both off by default
+struct BoardRules {
+    int respawn_ticks;   // Collected items come back this many ticks later (0: never)
+    int powerup_ticks;   // Power-up items double their collector's points this long (0: none)
+
+    BoardRules() : respawn_ticks(0), powerup_ticks(0) {}
+};
+
+// What the board's timers do; arg is the item or player
+enum BoardTimerKind { TIMER_RESPAWN, TIMER_BOOST_END };
+
+// One item in this many is a power-up when BoardRules::powerup_ticks is set
+const uint32_t POWERUP_ONE_IN = 16;
+
+class GameBoard {
+public:
+    int board_size;
+    std::vector<Player> players;
+    ItemStore items;
+
+    // Per-cell item index: the first item on each cell (-1 if none), with
+    // items stacked on the same cell chained through next_item. Only boards
+    // up to DENSE_INDEX_MAX_CELLS cells have one.
+    //
+    // Both indexes are fixed when the board is built; collected items stay
+    // in them and are skipped by their collected bit. That way the players
+    // and the collected bits are the board's whole state, which is what
+    // makes rolling it back cheap (see rollback.h).
+    std::vector<int> cell_items;
+    std::vector<int> next_item;
+
+    // Bigger boards are split into CHUNK_SIZE x CHUNK_SIZE chunks, and only
+    // chunks that had items when the board was built are kept, sorted by
+    // key. Each one is a range of chunk_items. Memory follows the items
+    // rather than the board area.
+    struct ChunkRange {
+        int start;
+        int count;
+    };
+    std::vector<uint32_t> chunk_keys;
+    std::vector<ChunkRange> chunk_ranges;
+    std::vector<int> chunk_items;
+
+    int items_remaining;
+
+    // Bumped when collected items come back (a respawn or a rollback), for
+    // anything that tracks the items by counting them
+    unsigned long restocks;
+
+    BoardRules rules;
+
+    // Respawns and power-up ends, fired by runTimers() at the start of
+    // each tick; tick is the tick being simulated
+    TimerWheel timers;
+    uint32_t tick;
+
+    // The items the last collectItemsAt() picked up
+    std::vector<uint32_t> collected_now;
+
+    // Set while a rollback replays ticks, whose collections were already
+    // announced once
+    bool replaying;
+
+    // Bumped whenever something visible changes, so the renderer can skip
+    // frames where nothing happened
+    unsigned long version;
+
+    GameBoard() : GameBoard(std::random_device()()) {}
+
+    // Boards built from the same seed, size, player and item count are
+    // identical. A size of 0 picks one from the seed like the interactive
+    // game does; a negative num_items places two items per row.
+    //
+    // Items are placed band by band, CHUNK_SIZE rows at a time: each band
+    // gets its share of the items and a generator of its own seeded from
+    // the board's, so big boards fill their bands in parallel on pool,
+    // straight into the item arrays, and come out the same either way.
+    explicit GameBoard(uint32_t seed, int size = 0, int num_players = 2, int num_items = -1,
+                       ThreadPool* pool = nullptr);
+
+    static const long DENSE_INDEX_MAX_CELLS = 1L << 22;
+    static const int CHUNK_SHIFT = 6;
+    static const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+
+    bool hasCellIndex() const { return !cell_items.empty(); }
+
+    int cellIndex(int x, int y) const {
+        return y * board_size + x;
+    }
+
+    // Chunk rows and columns both fit in 16 bits up to MAX_BOARD_SIZE
+    static uint32_t chunkKey(int x, int y) {
+        return ((uint32_t)(y >> CHUNK_SHIFT) << 16) | (uint32_t)(x >> CHUNK_SHIFT);
+    }
+
+    // Range of the chunk holding (x, y), or null if it never had items
+    const ChunkRange* findChunk(int x, int y) const {
+        uint32_t key = chunkKey(x, y);
+        auto it = std::lower_bound(chunk_keys.begin(), chunk_keys.end(), key);
+        if (it == chunk_keys.end() || *it != key) {
+            return nullptr;
+        }
+        return &chunk_ranges[it - chunk_keys.begin()];
+    }
+
+    // Collect every item stacked on (x, y) and return how many there were
+    int collectItemsAt(int x, int y) {
+        collected_now.clear();
+        if (!hasCellIndex()) {
+            return collectFromChunk(x, y);
+        }
+        int count = 0;
+        for (int i = cell_items[cellIndex(x, y)]; i != -1; i = next_item[i]) {
+            if (!items.isCollected(i)) {
+                items.markCollected(i);
+                collected_now.push_back((uint32_t)i);
+                count++;
+            }
+        }
+        items_remaining -= count;
+        return count;
+    }
+
+    // Whether any uncollected item is on (x, y); only reads the board
+    bool hasItemsAt(int x, int y) const {
+        if (hasCellIndex()) {
+            for (int i = cell_items[cellIndex(x, y)]; i != -1; i = next_item[i]) {
+                if (!items.isCollected(i)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        const ChunkRange* range = findChunk(x, y);
+        for (int k = range ? range->start : 0; range && k < range->start + range->count; ++k) {
+            int i = chunk_items[k];
+            if ((int)items.x(i) == x && (int)items.y(i) == y && !items.isCollected(i)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Remove item i as collected by nobody, e.g. when mirroring a board
+    // from the server; false if it was already gone
+    bool removeItem(int i);
+
+    // Put collected item i back; false if it wasn't collected
+    bool restoreItem(int i);
+
+    // Which items are power-ups depends on the board's seed
+    bool isPowerUp(size_t i) const {
+        return rules.powerup_ticks > 0 && SplitMix64::mix(board_seed ^ (i + 1)) % POWERUP_ONE_IN == 0;
+    }
+
+    // Call f(i) for every uncollected item in the size x size square at
+    // (left, top). Only looks at the cells or chunks the square covers
+    // when that is less work than going through every item.
+    template <typename F>
+    void forEachItemIn(int left, int top, int size, F f) const {
+        int right = std::min(left + size, board_size);
+        int bottom = std::min(top + size, board_size);
+        auto inside = [&](size_t i) {
+            return (int)items.x(i) >= left && (int)items.x(i) < right &&
+                   (int)items.y(i) >= top && (int)items.y(i) < bottom;
+        };
+        long area = (long)(right - left) * (bottom - top);
+        if (hasCellIndex() && area < (long)items.size()) {
+            for (int y = top; y < bottom; ++y) {
+                for (int x = left; x < right; ++x) {
+                    for (int i = cell_items[cellIndex(x, y)]; i != -1; i = next_item[i]) {
+                        if (!items.isCollected(i)) {
+                            f((size_t)i);
+                        }
+                    }
+                }
+            }
+        } else if (!hasCellIndex() && (area >> (2 * CHUNK_SHIFT)) < (long)chunk_keys.size()) {
+            for (int cy = top >> CHUNK_SHIFT; cy <= (bottom - 1) >> CHUNK_SHIFT; ++cy) {
+                for (int cx = left >> CHUNK_SHIFT; cx <= (right - 1) >> CHUNK_SHIFT; ++cx) {
+                    const ChunkRange* range = findChunk(cx << CHUNK_SHIFT, cy << CHUNK_SHIFT);
+                    if (!range) {
+                        continue;
+                    }
+                    for (int k = range->start; k < range->start + range->count; ++k) {
+                        int i = chunk_items[k];
+                        if (!items.isCollected(i) && inside(i)) {
+                            f((size_t)i);
+                        }
+                    }
+                }
+            }
+        } else {
+            items.forEachRemaining([&](size_t i) {
+                if (inside(i)) {
+                    f(i);
+                }
+            });
+        }
+    }
+
+private:
+    SplitMix64 gen;
+    uint64_t board_seed;
+    std::vector<Timer> due_timers;    // Scratch for runTimers
+    std::vector<uint32_t> scan_x;     // Scratch for collectUnderEach: the cells,
+    std::vector<uint32_t> scan_y;
+    std::vector<uint64_t> scan_hits;  // and the items found on them
+
+    friend void runTimers(GameBoard& board, uint32_t tick);
+    friend void collectUnderEach(GameBoard& board, const std::vector<int>& player_ids);
+
+    // Items worth spreading board construction over threads for
+    static const int PARALLEL_MIN_ITEMS = 1 << 16;
+
+    // Most item-cell pairs collectUnderEach compares in one pass, well
+    // under a microsecond of vector work; past that the index is cheaper
+    static const size_t SCAN_MAX_PAIRS = 1 << 13;
+
+    int bandCount() const { return (board_size - 1) / CHUNK_SIZE + 1; }
+    int bandStart(int band, int num_items) const;
+    void fillBand(int band, int num_items, uint64_t seed);
+    int sortBandByChunk(int band, int num_items, std::vector<uint64_t>& keyed, std::vector<int>& buckets);
+    void indexBandChunks(int band, int num_items, int chunk);
+    void buildDenseIndex();
+    int collectFromChunk(int x, int y);
+
+    void calculateBoardSize();
+    void initializePlayers(int num_players);
+    void initializeItems(int num_items, ThreadPool* pool);
+};
+
+// The board being played
+extern GameBoard* game;
+
+// Called after every collection, e.g. to play a sound; may be null
+extern void (*onCollect)();
+
+// Move a player of board, collecting whatever is on the cell it lands on.
+// True if it collected something.
+bool movePlayer(GameBoard& board, Player& player, int dx, int dy);
+
+// Give the player every item on its cell; true if there were any. Under
+// the board's rules this also schedules respawns and starts power-ups.
+bool collectUnder(GameBoard& board, Player& player);
+
+// collectUnder for each of player_ids in turn, all standing on different
+// cells. When there are few enough items, every cell is matched against
+// every item in one vectorized pass (matchCells) instead of one index
+// lookup per player.
+void collectUnderEach(GameBoard& board, const std::vector<int>& player_ids);
+
+// Start simulating tick: fire the board's timers due by then. Every loop
+// that advances a board calls this before resolving the tick's moves.
+void runTimers(GameBoard& board, uint32_t tick);
+
+// Undo a tick's timer ops, newest first, including the respawns they
+// made; see TimerWheel::setJournal. Players are restored separately.
+void undoTimers(GameBoard& board, const std::vector<TimerOp>& ops);
+void applyMessage(GameBoard& board, const GameMessage& msg);
+
+// The same on the global game
+bool movePlayer(Player& player, int dx, int dy);
+void applyMessage(const GameMessage& msg);
+bool isGameOver();
+
+// Indices of up to max_count players with the highest scores, best first;
+// ties go to the lower player number
+std::vector<int> leadingPlayers(const std::vector<Player>& players, size_t max_count);
+
+#endif // GAME_BOARD_H
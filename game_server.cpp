@@ -0,0 +1,409 @@
+#include "game_server.h"
+
+#include <iostream>
+#include "log.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "game_board.h"
+#include "move_resolver.h"
+#include "net_protocol.h"
+#include "trace.h"
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+namespace {
+
+const size_t MAX_CLIENT_BACKLOG = 256 * 1024;  // Unsent bytes before a slow client is dropped
+const int MAX_INPUTS_PER_TICK = 4;              // Per client; more are ignored
+const int GAME_OVER_LINGER_MS = 5000;           // Keep serving after the game ends
+const int MAX_EVENTS = 256;
+const uint64_t LISTEN_ID = 0;
+
+struct Client {
+    int fd;
+    uint32_t player_id;      // NET_NO_PLAYER for spectators
+    vector<uint8_t> in;
+    vector<uint8_t> out;
+    size_t out_pos;          // Bytes of out already sent
+    bool want_write;         // EPOLLOUT is armed
+    int inputs_this_tick;
+
+    Client(int socket, uint32_t id) : fd(socket), player_id(id), out_pos(0),
+                                      want_write(false), inputs_this_tick(0) {}
+};
+
+class GameServer {
+public:
+    explicit GameServer(const ServerOptions& opts);
+    ~GameServer();
+
+    bool start();
+    void run(const atomic<bool>& running);
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    void acceptClients();
+    void readClient(uint64_t id, Client& client);
+    bool flush(uint64_t id, Client& client);
+    void dropClient(uint64_t id);
+    void tick();
+
+    ServerOptions opts;
+    BoardInfo info;
+    GameBoard board;
+    DeltaEncoder deltas;
+    uint32_t tick_count;
+
+    int listen_fd;
+    int epoll_fd;
+    uint64_t next_id;
+    unordered_map<uint64_t, unique_ptr<Client> > clients;
+    vector<uint64_t> slot_owner;             // Client id per player slot, 0 if free
+    MoveResolver pending;                    // Inputs since the last tick
+    vector<uint8_t> delta;
+
+    // Totals for the summary at exit
+    size_t peak_clients;
+    uint64_t delta_bytes;
+    uint64_t delta_count;
+    uint64_t bytes_sent;
+    uint64_t ignored_inputs;
+    uint64_t slow_drops;
+};
+
+GameServer::GameServer(const ServerOptions& options) :
+    opts(options),
+    board(options.seed, options.board_size, options.players),
+    deltas(board),
+    tick_count(0),
+    listen_fd(-1),
+    epoll_fd(-1),
+    next_id(LISTEN_ID + 1),
+    slot_owner(board.players.size(), 0),
+    peak_clients(0), delta_bytes(0), delta_count(0), bytes_sent(0),
+    ignored_inputs(0), slow_drops(0) {
+    board.rules = options.rules;
+    info.seed = options.seed;
+    info.board_size = board.board_size;
+    info.num_players = (int)board.players.size();
+    info.num_items = (int)board.items.size();
+}
+
+GameServer::~GameServer() {
+    for (auto& entry : clients) {
+        close(entry.second->fd);
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (listen_fd >= 0) close(listen_fd);
+}
+
+bool GameServer::start() {
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        LOG_ERROR("socket: {}", strerror(errno));
+        return false;
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(opts.port);
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        LOG_ERROR("Failed to listen on port {}: {}", opts.port, strerror(errno));
+        return false;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        LOG_ERROR("epoll_create1: {}", strerror(errno));
+        return false;
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_ID;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    cout << "Serving on port " << opts.port << ": seed " << info.seed << ", board "
+         << info.board_size << "x" << info.board_size << ", " << info.num_players << " player slots, "
+         << opts.tick_rate << " ticks/s" << endl;
+    return true;
+}
+
+void GameServer::acceptClients() {
+    for (;;) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERROR("accept: {}", strerror(errno));
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint64_t id = next_id++;
+        uint32_t player = NET_NO_PLAYER;
+        for (size_t i = 0; i < slot_owner.size(); ++i) {
+            if (slot_owner[i] == 0) {
+                slot_owner[i] = id;
+                player = (uint32_t)i;
+                break;
+            }
+        }
+        Client* client = new Client(fd, player);
+        clients[id].reset(client);
+        peak_clients = max(peak_clients, clients.size());
+
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+        encodeWelcome(client->out, info, player, tick_count, board);
+        flush(id, *client);
+    }
+}
+
+void GameServer::readClient(uint64_t id, Client& client) {
+    uint8_t buf[4096];
+    for (;;) {
+        ssize_t n = recv(client.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            client.in.insert(client.in.end(), buf, buf + n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        dropClient(id);  // Closed or failed
+        return;
+    }
+
+    size_t pos = 0;
+    NetFrame frame;
+    long length;
+    while ((length = parseFrame(client.in.data() + pos, client.in.size() - pos, frame)) > 0) {
+        pos += (size_t)length;
+        int dir;
+        if (!decodeInput(frame, dir)) {
+            dropClient(id);
+            return;
+        }
+        if (client.player_id == NET_NO_PLAYER || client.inputs_this_tick >= MAX_INPUTS_PER_TICK) {
+            ignored_inputs++;
+            continue;
+        }
+        client.inputs_this_tick++;
+        pending.add((int)client.player_id, dir);
+    }
+    if (length < 0) {
+        dropClient(id);
+        return;
+    }
+    client.in.erase(client.in.begin(), client.in.begin() + pos);
+}
+
+// Send as much of the client's backlog as the socket takes. Returns false
+// if the client was dropped.
+bool GameServer::flush(uint64_t id, Client& client) {
+    while (client.out_pos < client.out.size()) {
+        ssize_t n = send(client.fd, &client.out[client.out_pos], client.out.size() - client.out_pos,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            client.out_pos += (size_t)n;
+            bytes_sent += (uint64_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            dropClient(id);
+            return false;
+        }
+    }
+
+    size_t backlog = client.out.size() - client.out_pos;
+    if (backlog > MAX_CLIENT_BACKLOG) {
+        slow_drops++;
+        dropClient(id);
+        return false;
+    }
+    if (backlog == 0) {
+        client.out.clear();
+        client.out_pos = 0;
+    } else if (client.out_pos > MAX_CLIENT_BACKLOG / 4) {
+        client.out.erase(client.out.begin(), client.out.begin() + client.out_pos);
+        client.out_pos = 0;
+    }
+
+    bool want_write = backlog != 0;
+    if (want_write != client.want_write) {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+        ev.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &ev);
+        client.want_write = want_write;
+    }
+    return true;
+}
+
+void GameServer::dropClient(uint64_t id) {
+    auto it = clients.find(id);
+    if (it == clients.end()) {
+        return;
+    }
+    Client& client = *it->second;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+    close(client.fd);
+    if (client.player_id != NET_NO_PLAYER) {
+        slot_owner[client.player_id] = 0;  // The player stays on the board for the next client
+    }
+    clients.erase(it);
+}
+
+// Resolve the inputs that arrived since the last tick and send everyone the
+// resulting delta, encoded once for all clients
+void GameServer::tick() {
+    TRACE_ZONE("server_tick");
+    runTimers(board, tick_count);
+    pending.resolve(board);
+    tick_count++;
+
+    delta.clear();
+    bool changed = deltas.encode(board, tick_count, delta);
+    if (changed) {
+        delta_bytes += delta.size();
+        delta_count++;
+    }
+
+    vector<uint64_t> ids;
+    ids.reserve(clients.size());
+    for (auto& entry : clients) {
+        ids.push_back(entry.first);
+    }
+    for (uint64_t id : ids) {
+        Client& client = *clients[id];
+        client.inputs_this_tick = 0;
+        if (changed) {
+            client.out.insert(client.out.end(), delta.begin(), delta.end());
+            flush(id, client);
+        }
+    }
+}
+
+void GameServer::run(const atomic<bool>& running) {
+    const Clock::duration tick_length =
+        chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / opts.tick_rate));
+    Clock::time_point next_tick = Clock::now() + tick_length;
+    Clock::time_point game_over_at;
+    bool game_over = false;
+    epoll_event events[MAX_EVENTS];
+
+    game = &board;
+    while (running) {
+        Clock::time_point now = Clock::now();
+        int timeout = 0;
+        if (next_tick > now) {
+            timeout = (int)chrono::duration_cast<chrono::milliseconds>(next_tick - now).count() + 1;
+        }
+        int n;
+        {
+            TRACE_ZONE("epoll_wait");
+            n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        }
+        TRACE_ZONE("handle_sockets");
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id == LISTEN_ID) {
+                acceptClients();
+                continue;
+            }
+            auto it = clients.find(id);
+            if (it == clients.end()) {
+                continue;  // Dropped earlier in this batch
+            }
+            Client& client = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                dropClient(id);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !flush(id, client)) {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                readClient(id, client);
+            }
+        }
+
+        now = Clock::now();
+        if (now >= next_tick) {
+            tick();
+            next_tick += tick_length;
+            if (now > next_tick + tick_length) {
+                next_tick = now + tick_length;  // Fell behind; don't try to catch up
+            }
+            if (!game_over && board.items_remaining == 0) {
+                game_over = true;
+                game_over_at = now;
+                vector<int> leaders = leadingPlayers(board.players, 1);
+                cout << "Game over after " << tick_count << " ticks; player "
+                     << board.players[leaders[0]].symbol << " wins with "
+                     << board.players[leaders[0]].score << endl;
+            }
+        }
+        if (game_over && now - game_over_at >= chrono::milliseconds(GAME_OVER_LINGER_MS)) {
+            break;
+        }
+    }
+    game = nullptr;
+
+    cout << "ticks: " << tick_count << "\n"
+         << "peak clients: " << peak_clients << "\n"
+         << "deltas: " << delta_count << " (avg "
+         << (delta_count ? delta_bytes / delta_count : 0) << " bytes)\n"
+         << "bytes sent: " << bytes_sent << "\n"
+         << "ignored inputs: " << ignored_inputs << "\n"
+         << "slow clients dropped: " << slow_drops << endl;
+}
+
+}
+
+int runServer(const ServerOptions& opts, const atomic<bool>& running) {
+    GameServer server(opts);
+    if (!server.start()) {
+        return 1;
+    }
+    server.run(running);
+    return 0;
+}
+
+#else
+
+int runServer(const ServerOptions&, const atomic<bool>&) {
+    LOG_ERROR("Server mode needs Linux (epoll)");
+    return 1;
+}
+
+#endif
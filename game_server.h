@@ -0,0 +1,23 @@
+#ifndef GAME_SERVER_H
+#define GAME_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include "game_board.h"
+
+struct ServerOptions {
+    uint16_t port;
+    uint32_t seed;
+    int board_size;  // 0 = derive from the seed
+    int players;     // Player slots; each client takes a free one
+    int tick_rate;
+    BoardRules rules;
+};
+
+// Run an authoritative game server until running goes false or the game
+// has been over for a few seconds. Clients connect over TCP, get the whole
+// board once and then only per-tick deltas. One thread serves every client
+// from an epoll loop. Returns a process exit code.
+int runServer(const ServerOptions& opts, const std::atomic<bool>& running);
+
+#endif // GAME_SERVER_H
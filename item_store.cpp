@@ -0,0 +1,19 @@
+#include "item_store.h"
+
+namespace {
+const uint32_t PADDING = 0xFFFFFFFF;
+
+size_t roundUp(size_t n, size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+}
+
+void ItemStore::resize(size_t n) {
+    count = n;
+    xs.assign(roundUp(n, SIMD_BLOCK), PADDING);
+    ys.assign(roundUp(n, SIMD_BLOCK), PADDING);
+    collected.assign(roundUp(n, 64) / 64, 0);
+    if (n % 64) {
+        collected.back() = ~0ULL << (n % 64);
+    }
+}
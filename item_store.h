@@ -0,0 +1,89 @@
+#ifndef ITEM_STORE_H
+#define ITEM_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "simd_kernels.h"
+
+// Largest board size. Item coordinates are 32-bit; 0xFFFFFFFF is kept
+// free as the padding value.
+const int MAX_BOARD_SIZE = 1 << 20;
+
+// Items as a structure of arrays: x and y in separate 32-bit arrays and the
+// collected flags in a bitset. Scanning thousands of items streams through
+// two compact arrays (8 items per 32-byte vector) instead of striding
+// over padded structs and testing a bool per item.
+//
+// The coordinate arrays are padded to a multiple of SIMD_BLOCK with an
+// off-board coordinate, and every bit past the last item is set, so
+// kernels can work in whole blocks and whole words.
+class ItemStore {
+public:
+    ItemStore() : count(0), journal(nullptr) {}
+
+    size_t size() const { return count; }
+    size_t wordCount() const { return collected.size(); }
+
+    // Make room for n items, all uncollected, to be placed with set();
+    // different items can be set from different threads
+    void resize(size_t n);
+    void set(size_t i, uint32_t x, uint32_t y) {
+        xs[i] = x;
+        ys[i] = y;
+    }
+
+    uint32_t x(size_t i) const { return xs[i]; }
+    uint32_t y(size_t i) const { return ys[i]; }
+
+    bool isCollected(size_t i) const {
+        return (collected[i / 64] >> (i % 64)) & 1;
+    }
+
+    void markCollected(size_t i) {
+        collected[i / 64] |= 1ULL << (i % 64);
+        if (journal) {
+            journal->push_back((uint32_t)i);
+        }
+    }
+
+    // Put a collected item back, undoing markCollected
+    void uncollect(size_t i) {
+        collected[i / 64] &= ~(1ULL << (i % 64));
+    }
+
+    // While set, every item collected is also appended to journal, so the
+    // collections can be undone; null to stop
+    void setJournal(std::vector<uint32_t>* out) { journal = out; }
+
+    // Items not collected yet, by popcount over the bitset
+    size_t countRemaining() const {
+        return collected.size() * 64 - popcountWords(collected.data(), collected.size());
+    }
+
+    // Call f(i) for every uncollected item in index order
+    template <typename F>
+    void forEachRemaining(F f) const {
+        for (size_t w = 0; w < collected.size(); ++w) {
+            uint64_t bits = ~collected[w];
+            while (bits) {
+                f(w * 64 + (size_t)__builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    // Raw arrays for the kernels in simd_kernels.h
+    const uint32_t* xData() const { return xs.data(); }
+    const uint32_t* yData() const { return ys.data(); }
+    const uint64_t* collectedData() const { return collected.data(); }
+
+private:
+    size_t count;
+    std::vector<uint32_t> xs;
+    std::vector<uint32_t> ys;
+    std::vector<uint64_t> collected;  // Bit i set once item i is collected
+    std::vector<uint32_t>* journal;
+};
+
+#endif // ITEM_STORE_H
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "metrics.h"
+#include "shm_input.h"
+
+using namespace std;
+
+// Load generator for a game started with --shm-input: forks --processes
+// producers, each of which attaches to the game's shared memory on its own
+// lane and pushes random moves for --duration seconds, --rate moves per
+// second each (0 = as fast as the game takes them).
+
+struct LoadgenOptions {
+    string path;
+    int processes;
+    long rate;
+    int duration;
+    int batch;
+    uint32_t seed;
+
+    LoadgenOptions() : processes(1), rate(0), duration(10), batch(64), seed(0) {}
+};
+
+// What each producer did, in memory shared with the parent
+struct ProducerResult {
+    uint64_t moves;
+    uint64_t full_waits;
+    double seconds;      // Until the last push that got anything through
+    bool attached;
+    bool stalled;        // Stopped early: the game took nothing for 100 ms
+};
+
+volatile sig_atomic_t stopping = 0;
+
+void handleSignal(int) {
+    stopping = 1;
+}
+
+void printUsage(const char* prog) {
+    cerr << "Usage: " << prog << " PATH [options]\n"
+         << "  PATH              The shared memory a --shm-input game printed\n"
+         << "  --processes N     Producer processes (default 1)\n"
+         << "  --rate N          Moves per second per process (default 0: flat out)\n"
+         << "  --duration S      Stop after S seconds (default 10)\n"
+         << "  --batch N         Moves per push (default 64)\n"
+         << "  --seed N          Seed the moves; process p uses seed + p\n";
+}
+
+bool parseOptions(int argc, char* argv[], LoadgenOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--processes" && has_value) {
+            opts.processes = atoi(argv[++i]);
+        } else if (arg == "--rate" && has_value) {
+            opts.rate = atol(argv[++i]);
+        } else if (arg == "--duration" && has_value) {
+            opts.duration = atoi(argv[++i]);
+        } else if (arg == "--batch" && has_value) {
+            opts.batch = atoi(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            opts.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (opts.path.empty() && arg[0] != '-') {
+            opts.path = arg;
+        } else {
+            return false;
+        }
+    }
+    return !opts.path.empty() && opts.processes > 0 && opts.processes <= (int)SHM_LANES &&
+           opts.rate >= 0 && opts.duration > 0 && opts.batch > 0;
+}
+
+// One producer process. At a set rate, batches go out on a fixed
+// schedule and a producer that falls behind doesn't try to catch up. Stops
+// early once the game stops taking moves, e.g. because it exited or the
+// game is over.
+void runProducer(const LoadgenOptions& opts, int index, ProducerResult& result) {
+    ShmInputRing ring;
+    if (!ring.attach(opts.path) || ring.players() <= 0) {
+        return;
+    }
+    result.attached = true;
+    mt19937 rng(opts.seed + (uint32_t)index);
+    uniform_int_distribution<int> player(0, ring.players() - 1);
+    uniform_int_distribution<int> dir(0, 3);
+    vector<ShmMove> batch(opts.batch);
+
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + chrono::seconds(opts.duration);
+    Clock::duration interval = opts.rate > 0 ?
+        chrono::duration_cast<Clock::duration>(chrono::duration<double>((double)opts.batch / opts.rate)) :
+        Clock::duration::zero();
+    Clock::time_point next = start;
+    Clock::time_point now = start;
+    Clock::time_point last_push = start;
+    while (!stopping && now < end) {
+        uint64_t created_ns = nowNs();
+        for (auto& move : batch) {
+            move.player_id = player(rng);
+            move.dir = dir(rng);
+            move.created_ns = created_ns;
+        }
+        // Wait for room at most 100 ms at a time, to notice the deadline
+        size_t pushed = ring.push(batch.data(), batch.size(), 100);
+        now = Clock::now();
+        if (pushed == 0) {
+            result.stalled = true;
+            break;
+        }
+        result.moves += pushed;
+        last_push = now;
+        if (opts.rate > 0) {
+            next += interval;
+            if (now > next + interval) {
+                next = now;
+            }
+            this_thread::sleep_until(next);
+            now = Clock::now();
+        }
+    }
+    result.full_waits = ring.fullWaits();
+    result.seconds = chrono::duration<double>(last_push - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    LoadgenOptions opts;
+    if (!parseOptions(argc, argv, opts)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    void* mem = mmap(nullptr, sizeof(ProducerResult) * opts.processes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        cerr << "Failed to map the results: " << strerror(errno) << "\n";
+        return 1;
+    }
+    ProducerResult* results = (ProducerResult*)mem;
+    memset(results, 0, sizeof(ProducerResult) * opts.processes);
+
+    vector<pid_t> children;
+    for (int p = 0; p < opts.processes; ++p) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "fork failed: " << strerror(errno) << "\n";
+            break;
+        }
+        if (pid == 0) {
+            runProducer(opts, p, results[p]);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    vector<bool> exited(children.size());
+    for (size_t p = 0; p < children.size(); ++p) {
+        int status = 0;
+        while (waitpid(children[p], &status, 0) < 0 && errno == EINTR) {
+        }
+        exited[p] = WIFEXITED(status);
+    }
+
+    uint64_t total = 0;
+    double seconds = 0;
+    int attached = 0;
+    for (size_t p = 0; p < children.size(); ++p) {
+        const ProducerResult& result = results[p];
+        if (!result.attached) {
+            cout << "process " << p << ": could not attach to " << opts.path << "\n";
+            continue;
+        }
+        if (!exited[p]) {
+            // Killed: its count is as of its last push, and its lane is
+            // free for the next producer
+            cout << "process " << p << ": killed after " << result.moves << " moves\n";
+            total += result.moves;
+            continue;
+        }
+        double s = result.seconds > 0 ? result.seconds : 1e-9;
+        cout << "process " << p << ": " << result.moves << " moves, " << result.moves / s
+             << " moves/s, waited for room " << result.full_waits << " times"
+             << (result.stalled ? " (stopped: the game stopped taking moves)" : "") << "\n";
+        total += result.moves;
+        seconds = max(seconds, s);
+        attached++;
+    }
+    if (attached == 0) {
+        return 1;
+    }
+    cout << "total: " << total << " moves, " << total / seconds << " moves/s from "
+         << attached << " processes\n";
+    return 0;
+}
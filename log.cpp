@@ -0,0 +1,251 @@
+#include "log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "message_queue.h"
+#include "trace.h"
+
+using namespace std;
+
+atomic<int> logLevel(LOG_LEVEL_INFO);
+
+namespace {
+
+const size_t LOG_RING_SIZE = 2048;     // Records per thread, 256 KB
+const int FLUSH_INTERVAL_MS = 20;
+const char* const LEVEL_NAMES[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+// Timestamps are printed relative to this
+const uint64_t START_NS = nowNs();
+
+typedef SpscQueue<LogRecord, LOG_RING_SIZE> LogRing;
+
+// One producer thread's ring. Rings outlive their threads and are drained
+// until the process exits.
+struct Lane {
+    LogRing* ring;
+    atomic<uint64_t> dropped;
+
+    Lane() : ring(new LogRing()), dropped(0) {}
+};
+
+// Never destroyed, so threads and static destructors can log right up to
+// exit; an atexit handler stops the writer and writes what is left.
+struct Logger {
+    mutex lanes_mutex;
+    vector<Lane*> lanes;
+    mutex drain_mutex;                 // The rings' single consumer
+    vector<LogRecord> batch;
+    string out;
+    string err;
+    FILE* file;                        // Every level goes here if set
+    thread writer;
+    atomic<bool> stopping;
+    bool started;
+    EventNotifier notifier;
+
+    Logger() : file(nullptr), stopping(false), started(false) {}
+};
+
+Logger& logger() {
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+thread_local Lane* thread_lane = nullptr;
+
+void appendRecord(Logger& log, const LogRecord& record) {
+    string& line = record.level >= LOG_LEVEL_WARN ? log.err : log.out;
+    char number[32];
+    snprintf(number, sizeof(number), "[%11.6f] ",
+             record.ns > START_NS ? (record.ns - START_NS) / 1e9 : 0.0);
+    line += number;
+    line += LEVEL_NAMES[min<int>(record.level, LOG_LEVEL_ERROR)];
+    line += ' ';
+
+    int arg = 0;
+    for (const char* p = record.format; *p; ++p) {
+        if (p[0] != '{' || p[1] != '}') {
+            line += *p;
+            continue;
+        }
+        p++;
+        if (arg >= record.num_args) {
+            line += "{}";
+            continue;
+        }
+        switch (record.types[arg]) {
+        case LogRecord::ARG_CHAR:
+            line += (char)record.args[arg];
+            break;
+        case LogRecord::ARG_TEXT:
+            line += record.text + record.args[arg];
+            break;
+        default:
+            snprintf(number, sizeof(number), "%lld", (long long)record.args[arg]);
+            line += number;
+        }
+        arg++;
+    }
+    line += '\n';
+}
+
+void writeStream(FILE* stream, string& text) {
+    if (!text.empty()) {
+        fwrite(text.data(), 1, text.size(), stream);
+        fflush(stream);
+        text.clear();
+    }
+}
+
+void writeAll(Logger& log) {
+    if (log.file) {
+        log.out += log.err;
+        log.err.clear();
+        writeStream(log.file, log.out);
+    } else {
+        writeStream(stdout, log.out);
+        writeStream(stderr, log.err);
+    }
+}
+
+// Drain every ring and write the records in timestamp order
+void drainAndWrite(Logger& log) {
+    lock_guard<mutex> lock(log.drain_mutex);
+    vector<Lane*> lanes;
+    {
+        lock_guard<mutex> lanes_lock(log.lanes_mutex);
+        lanes = log.lanes;
+    }
+    log.batch.clear();
+    LogRecord chunk[64];
+    for (Lane* lane : lanes) {
+        size_t n;
+        while ((n = lane->ring->popBatch(chunk, 64)) > 0) {
+            log.batch.insert(log.batch.end(), chunk, chunk + n);
+        }
+    }
+    if (log.batch.empty()) {
+        return;
+    }
+    stable_sort(log.batch.begin(), log.batch.end(), [](const LogRecord& a, const LogRecord& b) {
+        return a.ns < b.ns;
+    });
+    for (const auto& record : log.batch) {
+        appendRecord(log, record);
+    }
+    writeAll(log);
+}
+
+void writerLoop() {
+    TRACE_THREAD("logger");
+    Logger& log = logger();
+    while (!log.stopping.load(memory_order_relaxed)) {
+        log.notifier.waitUnless(FLUSH_INTERVAL_MS, []() { return false; });
+        TRACE_ZONE("write_log");
+        drainAndWrite(log);
+    }
+}
+
+void stopLogger() {
+    Logger& log = logger();
+    {
+        lock_guard<mutex> lock(log.lanes_mutex);
+        log.stopping = true;
+    }
+    log.notifier.notify();
+    if (log.writer.joinable()) {
+        log.writer.join();
+    }
+    drainAndWrite(log);
+    uint64_t dropped = droppedLogRecords();
+    if (dropped > 0) {
+        fprintf(stderr, "%llu log records dropped\n", (unsigned long long)dropped);
+    }
+}
+
+Lane* registerThread() {
+    Logger& log = logger();
+    lock_guard<mutex> lock(log.lanes_mutex);
+    if (!log.started && !log.stopping) {
+        log.started = true;
+        log.writer = thread(writerLoop);
+        atexit(stopLogger);
+    }
+    Lane* lane = new Lane();
+    log.lanes.push_back(lane);
+    return lane;
+}
+
+}
+
+void LogRecord::putText(const char* value, size_t length) {
+    if (!slot()) {
+        return;
+    }
+    size_t offset = min<size_t>(text_used, TEXT_SIZE - 1);
+    length = min(length, TEXT_SIZE - 1 - offset);
+    memcpy(text + offset, value, length);
+    text[offset + length] = '\0';
+    types[num_args] = ARG_TEXT;
+    args[num_args++] = (int64_t)offset;
+    text_used = (uint16_t)min(offset + length + 1, TEXT_SIZE);
+}
+
+void pushLogRecord(LogRecord& record) {
+    Logger& log = logger();
+    if (log.stopping.load(memory_order_relaxed)) {
+        // Logged during exit, after the writer stopped
+        lock_guard<mutex> lock(log.drain_mutex);
+        appendRecord(log, record);
+        writeAll(log);
+        return;
+    }
+    if (!thread_lane) {
+        thread_lane = registerThread();
+    }
+    if (!thread_lane->ring->push(record)) {
+        thread_lane->dropped.fetch_add(1, memory_order_relaxed);
+    } else if (record.level >= LOG_LEVEL_WARN) {
+        log.notifier.notify();  // Don't sit on problems until the next flush
+    }
+}
+
+void setLogLevel(LogLevel level) {
+    logLevel.store(level, memory_order_relaxed);
+}
+
+bool parseLogLevel(const string& name, LogLevel& level) {
+    const char* const names[] = {"debug", "info", "warn", "error", "off"};
+    for (int i = 0; i <= LOG_LEVEL_OFF; ++i) {
+        if (name == names[i]) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void setLogFile(FILE* file) {
+    Logger& log = logger();
+    lock_guard<mutex> lock(log.drain_mutex);
+    log.file = file;
+}
+
+void flushLog() {
+    drainAndWrite(logger());
+}
+
+uint64_t droppedLogRecords() {
+    Logger& log = logger();
+    lock_guard<mutex> lock(log.lanes_mutex);
+    uint64_t total = 0;
+    for (Lane* lane : log.lanes) {
+        total += lane->dropped.load(memory_order_relaxed);
+    }
+    return total;
+}
@@ -0,0 +1,124 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "metrics.h"
+
+// Structured, asynchronous logging.
+//
+// A log call copies its format string pointer, its arguments and a
+// timestamp into a fixed-size record and pushes it into the calling
+// thread's own lock-free ring; nothing is formatted and no lock is taken.
+// A background thread drains every ring a few times a second, formats the
+// records in timestamp order and writes each batch with one write per
+// stream. Errors and warnings go to stderr, everything else to stdout.
+//
+// Formats use {} for each argument, which may be any integer, a char,
+// or a string (copied, up to the space left in the record):
+//
+//   LOG_INFO("Player {} collected an item! Score: {}", player.symbol, player.score);
+//
+// Levels below LOG_COMPILE_LEVEL are compiled out entirely (build with
+// e.g. -DLOG_COMPILE_LEVEL=1 to drop debug logging); levels below the
+// runtime level set with setLogLevel() cost one relaxed load.
+enum LogLevel {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF
+};
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+extern std::atomic<int> logLevel;
+
+void setLogLevel(LogLevel level);
+
+// "debug", "info", "warn", "error" or "off"
+bool parseLogLevel(const std::string& name, LogLevel& level);
+
+// Write every level to file instead of stdout and stderr; null restores
+// the default
+void setLogFile(FILE* file);
+
+// Write out everything logged so far and wait until it is written
+void flushLog();
+
+// Records dropped because a thread's ring was full
+uint64_t droppedLogRecords();
+
+// One log call, 128 bytes
+struct LogRecord {
+    enum ArgType { ARG_INT, ARG_CHAR, ARG_TEXT };
+    static const int MAX_ARGS = 4;
+    static const size_t TEXT_SIZE = 72;
+
+    uint64_t ns;
+    const char* format;
+    int64_t args[MAX_ARGS];     // Value, or offset into text for ARG_TEXT
+    uint8_t types[MAX_ARGS];
+    uint8_t level;
+    uint8_t num_args;
+    uint16_t text_used;
+    char text[TEXT_SIZE];       // Copied string arguments, each NUL terminated
+
+    void pack() {}
+
+    template <typename T, typename... Rest>
+    void pack(const T& value, const Rest&... rest) {
+        put(value);
+        pack(rest...);
+    }
+
+private:
+    bool slot() const { return num_args < MAX_ARGS; }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type put(T value) {
+        if (slot()) {
+            types[num_args] = std::is_same<T, char>::value ? ARG_CHAR : ARG_INT;
+            args[num_args++] = (int64_t)value;
+        }
+    }
+
+    void put(const char* value) { putText(value, strlen(value)); }
+    void put(const std::string& value) { putText(value.data(), value.size()); }
+    void putText(const char* value, size_t length);
+};
+
+// Queue a record on this thread's ring; use the LOG_* macros instead
+void pushLogRecord(LogRecord& record);
+
+template <typename... Args>
+void logEvent(LogLevel level, const char* format, const Args&... args) {
+    LogRecord record;
+    record.ns = nowNs();
+    record.format = format;
+    record.level = (uint8_t)level;
+    record.num_args = 0;
+    record.text_used = 0;
+    record.pack(args...);
+    pushLogRecord(record);
+}
+
+#define LOG_AT(level, ...) \
+    do { \
+        if ((level) >= LOG_COMPILE_LEVEL && (level) >= logLevel.load(std::memory_order_relaxed)) { \
+            logEvent((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,254 @@
+#ifndef MESSAGE_QUEUE_H
+#define MESSAGE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+// Size of a cache line on the machines we target (x86-64 and Apple silicon
+// both use 64 bytes for L1; the M1's 128 byte L2 line is fine with this too)
+const size_t CACHE_LINE_SIZE = 64;
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// The consumer's head and the producer's tail sit on separate cache lines,
+// and each side keeps a private copy of the other side's index so it only
+// touches the shared line when it looks like the queue is empty/full.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+
+    // Keep heap-allocated queues cache-line aligned too
+    static void* operator new(size_t size) {
+        void* mem = nullptr;
+        if (posix_memalign(&mem, CACHE_LINE_SIZE, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return mem;
+    }
+
+    static void operator delete(void* mem) {
+        free(mem);
+    }
+
+    // Producer side. Returns false (and drops the value) if the queue is full.
+    bool push(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead == Capacity) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead == Capacity) {
+                return false;
+            }
+        }
+        buffer[t & (Capacity - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies up to maxCount pending values into out and
+    // releases their slots with a single store. Returns the number copied.
+    size_t popBatch(T* out, size_t maxCount) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (cachedTail == h) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (cachedTail == h) {
+                return 0;
+            }
+        }
+        size_t count = cachedTail - h;
+        if (count > maxCount) {
+            count = maxCount;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = buffer[(h + i) & (Capacity - 1)];
+        }
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Written by the consumer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+    size_t cachedTail;
+
+    // Written by the producer
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+    size_t cachedHead;
+
+    alignas(CACHE_LINE_SIZE) T buffer[Capacity];
+};
+
+// Wakes a sleeping consumer when producers post work.
+//
+// Backed by an eventfd on Linux and a non-blocking pipe elsewhere. The fd is
+// only written when the consumer has announced that it is about to sleep, so
+// a busy consumer never costs the producers a syscall.
+class EventNotifier {
+public:
+    EventNotifier() : sleeping(false), read_fd(-1), write_fd(-1) {
+#ifdef __linux__
+        read_fd = write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+        int fds[2];
+        if (pipe(fds) == 0) {
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+            fcntl(fds[1], F_SETFL, O_NONBLOCK);
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            read_fd = fds[0];
+            write_fd = fds[1];
+        }
+#endif
+    }
+
+    ~EventNotifier() {
+        if (read_fd >= 0) close(read_fd);
+        if (write_fd >= 0 && write_fd != read_fd) close(write_fd);
+    }
+
+    bool valid() const { return read_fd >= 0; }
+
+    // Producer side, call after pushing
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false)) {
+            uint64_t one = 1;
+            ssize_t ignored = write(write_fd, &one, write_fd == read_fd ? sizeof(one) : 1);
+            (void)ignored;
+        }
+    }
+
+    // Consumer side. Sleeps for up to timeout_ms unless hasWork() reports
+    // pending work; hasWork is re-checked after announcing the sleep so a
+    // push racing with us can't be missed.
+    template <typename Predicate>
+    void waitUnless(int timeout_ms, Predicate hasWork) {
+        if (timeout_ms <= 0) {
+            return;
+        }
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasWork()) {
+            struct pollfd pfd;
+            pfd.fd = read_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            poll(&pfd, 1, timeout_ms);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+        drain();
+    }
+
+private:
+    void drain() {
+        uint64_t buf[8];
+        while (read(read_fd, buf, sizeof(buf)) > 0) {
+        }
+    }
+
+    std::atomic<bool> sleeping;
+    int read_fd;
+    int write_fd;
+};
+
+// Many-to-one message queue built from one SPSC lane per producer thread.
+//
+// Each producer thread is given its own lane index and is the only thread
+// that ever pushes into that lane, so producers never contend with each
+// other and no lane needs a lock or a file descriptor. The consumer drains
+// every lane in turn, and all lanes share one EventNotifier.
+template <typename T, size_t LaneCapacity>
+class FanInQueue {
+public:
+    typedef SpscQueue<T, LaneCapacity> Lane;
+
+    explicit FanInQueue(size_t num_lanes) : dropped(0) {
+        for (size_t i = 0; i < num_lanes; ++i) {
+            lanes.push_back(new Lane());
+        }
+    }
+
+    ~FanInQueue() {
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            delete lanes[i];
+        }
+    }
+
+    size_t laneCount() const { return lanes.size(); }
+
+    bool valid() const { return notifier.valid(); }
+
+    // Producer side; lane must be owned by the calling thread
+    bool post(size_t lane, const T& value) {
+        if (!lanes[lane]->push(value)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        notifier.notify();
+        return true;
+    }
+
+    // Consumer side. Hands every pending message to apply, one batch per
+    // lane at a time, and returns how many were applied.
+    template <typename Apply>
+    size_t drain(Apply apply) {
+        const size_t BATCH_SIZE = 64;
+        T batch[BATCH_SIZE];
+        size_t total = 0;
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            size_t count;
+            while ((count = lanes[i]->popBatch(batch, BATCH_SIZE)) > 0) {
+                for (size_t j = 0; j < count; ++j) {
+                    apply(batch[j]);
+                }
+                total += count;
+            }
+        }
+        return total;
+    }
+
+    // Consumer side
+    bool hasPending() const {
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            if (!lanes[i]->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Consumer side. Sleeps for up to timeout_ms unless a message is waiting.
+    void wait(int timeout_ms) {
+        notifier.waitUnless(timeout_ms, [this]() { return hasPending(); });
+    }
+
+    // Messages lost because their lane was full
+    size_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    FanInQueue(const FanInQueue&);
+    FanInQueue& operator=(const FanInQueue&);
+
+    std::vector<Lane*> lanes;
+    EventNotifier notifier;
+    std::atomic<size_t> dropped;
+};
+
+#endif // MESSAGE_QUEUE_H
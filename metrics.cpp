@@ -0,0 +1,108 @@
+#include "metrics.h"
+
+#include <fstream>
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketFor(uint64_t value) {
+    if (value < (uint64_t)SUB_BUCKETS) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(bucket % SUB_BUCKETS) + SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    counts[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    uint64_t seen = maxValue.load(std::memory_order_relaxed);
+    while (ns > seen && !maxValue.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)n);
+    if (rank >= n) {
+        rank = n - 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            uint64_t bound = bucketUpperBound(i);
+            return bound < max() ? bound : max();
+        }
+    }
+    return max();
+}
+
+GameMetrics::GameMetrics() : messages(0), frames(0), ticks(0), coalesced(0), unsampled(0) {}
+
+GameMetrics metrics;
+
+namespace {
+void writeHistogram(std::ofstream& out, const char* name, const LatencyHistogram& h, bool last) {
+    out << "    \"" << name << "\": {\"count\": " << h.count()
+        << ", \"p50\": " << h.percentile(50)
+        << ", \"p99\": " << h.percentile(99)
+        << ", \"p999\": " << h.percentile(99.9)
+        << ", \"max\": " << h.max() << "}" << (last ? "\n" : ",\n");
+}
+}
+
+bool writeMetricsJson(const std::string& path, const GameMetrics& metrics,
+                      double seconds, uint64_t dropped) {
+    std::ofstream out(path.c_str());
+    if (!out) {
+        return false;
+    }
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    out << "{\n  \"duration_s\": " << seconds << ",\n";
+    out << "  \"latency_ns\": {\n";
+    writeHistogram(out, "queue", metrics.queueLatency, false);
+    writeHistogram(out, "apply", metrics.applyLatency, false);
+    writeHistogram(out, "present", metrics.presentLatency, false);
+    writeHistogram(out, "input_to_photon", metrics.inputToPhoton, false);
+    writeHistogram(out, "frame", metrics.frameTime, false);
+    writeHistogram(out, "tick", metrics.tickTime, true);
+    out << "  },\n";
+    out << "  \"counters\": {\n"
+        << "    \"messages\": " << metrics.messages.load() << ",\n"
+        << "    \"frames\": " << metrics.frames.load() << ",\n"
+        << "    \"ticks\": " << metrics.ticks.load() << ",\n"
+        << "    \"dropped_inputs\": " << dropped << ",\n"
+        << "    \"coalesced_inputs\": " << metrics.coalesced.load() << ",\n"
+        << "    \"unsampled_inputs\": " << metrics.unsampled.load() << "\n"
+        << "  },\n";
+    out << "  \"rates\": {\n"
+        << "    \"messages_per_second\": " << metrics.messages.load() / seconds << ",\n"
+        << "    \"frames_per_second\": " << metrics.frames.load() / seconds << "\n"
+        << "  }\n}\n";
+    return (bool)out;
+}
@@ -0,0 +1,75 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Monotonic clock in nanoseconds, used for all latency timestamps
+inline uint64_t nowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Lock-free latency histogram with log-linear buckets.
+//
+// Every power of two is split into 8 sub-buckets, so a percentile is
+// accurate to within 12.5% of its value across the whole 64-bit range.
+// record() is a couple of relaxed atomic adds and can be called from any
+// thread; readers see a slightly fuzzy but never torn view.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxValue.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the given percentile (0-100), or 0
+    // if nothing was recorded
+    uint64_t percentile(double p) const;
+
+private:
+    static const int SUB_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+    static int bucketFor(uint64_t value);
+    static uint64_t bucketUpperBound(int bucket);
+
+    std::atomic<uint64_t> counts[NUM_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maxValue;
+};
+
+// Input latency and throughput counters for one game
+struct GameMetrics {
+    // Per-input stages, from the GameMessage timestamps
+    LatencyHistogram queueLatency;     // Created -> dequeued by the simulation
+    LatencyHistogram applyLatency;     // Dequeued -> applied by movePlayer
+    LatencyHistogram presentLatency;   // Applied -> SDL_RenderPresent
+    LatencyHistogram inputToPhoton;    // Created -> SDL_RenderPresent
+
+    LatencyHistogram frameTime;        // Drawing and presenting one frame
+    LatencyHistogram tickTime;         // One simulation tick
+
+    std::atomic<uint64_t> messages;    // Inputs applied
+    std::atomic<uint64_t> frames;      // Frames presented
+    std::atomic<uint64_t> ticks;       // Simulation ticks
+    std::atomic<uint64_t> coalesced;   // Key repeats merged because we fell behind
+    std::atomic<uint64_t> unsampled;   // Applied inputs whose present time wasn't tracked
+
+    GameMetrics();
+};
+
+// Metrics of the running game
+extern GameMetrics metrics;
+
+// Write metrics as JSON; dropped is the number of inputs lost to full queues
+bool writeMetricsJson(const std::string& path, const GameMetrics& metrics,
+                      double seconds, uint64_t dropped);
+
+#endif // METRICS_H
@@ -0,0 +1,147 @@
+#include "move_resolver.h"
+
+#include <algorithm>
+#include "trace.h"
+
+using namespace std;
+
+size_t MoveResolver::add(int player_id, int dir) {
+    Queued move = {player_id, dir};
+    queued.push_back(move);
+    return queued.size() - 1;
+}
+
+size_t MoveResolver::resolve(GameBoard& board, ThreadPool* pool) {
+    TRACE_ZONE("resolve_moves");
+    outcome.assign(queued.size(), 0);
+    if (player_steps.size() < board.players.size()) {
+        player_steps.resize(board.players.size(), 0);
+    }
+
+    // Step k holds every player's k-th move
+    size_t num_steps = 0;
+    for (size_t i = 0; i < queued.size(); ++i) {
+        const Queued& move = queued[i];
+        if (move.player_id < 0 || move.player_id >= (int)board.players.size() || move.dir < 0 || move.dir > 3) {
+            continue;
+        }
+        size_t step = (size_t)player_steps[move.player_id]++;
+        if (step == steps.size()) {
+            steps.emplace_back();
+        }
+        steps[step].push_back(i);
+        num_steps = max(num_steps, step + 1);
+    }
+    for (const auto& move : queued) {
+        if (move.player_id >= 0 && move.player_id < (int)board.players.size()) {
+            player_steps[move.player_id] = 0;
+        }
+    }
+
+    for (size_t s = 0; s < num_steps; ++s) {
+        resolveStep(board, steps[s], pool);
+        steps[s].clear();
+    }
+    queued.clear();
+    return (size_t)count(outcome.begin(), outcome.end(), 1);
+}
+
+void MoveResolver::resolveStep(GameBoard& board, const vector<size_t>& step, ThreadPool* pool) {
+    // As many strips as there are threads to resolve them, the calling
+    // one included, each a power of two rows high
+    int size = board.board_size;
+    size_t parts = pool && step.size() >= PARALLEL_MIN_MOVES ? pool->size() + 1 : 1;
+    int shift = MIN_STRIP_SHIFT;
+    while ((size_t)((size - 1) >> shift) + 1 > parts) {
+        shift++;
+    }
+    size_t strips = (size_t)((size - 1) >> shift) + 1;
+
+    // Bucket the moves that stay on the board by destination strip
+    strip_start.assign(strips + 1, 0);
+    for (size_t i : step) {
+        const Player& player = board.players[queued[i].player_id];
+        int x = player.x + DIR_DX[queued[i].dir];
+        int y = player.y + DIR_DY[queued[i].dir];
+        if (x >= 0 && x < size && y >= 0 && y < size) {
+            strip_start[(y >> shift) + 1]++;
+        }
+    }
+    for (size_t s = 0; s < strips; ++s) {
+        strip_start[s + 1] += strip_start[s];
+    }
+    arrivals.resize(strip_start[strips]);
+    vector<size_t> fill(strip_start.begin(), strip_start.end() - 1);
+    for (size_t i : step) {
+        const Player& player = board.players[queued[i].player_id];
+        int x = player.x + DIR_DX[queued[i].dir];
+        int y = player.y + DIR_DY[queued[i].dir];
+        if (x >= 0 && x < size && y >= 0 && y < size) {
+            Arrival arrival = {((uint64_t)y << 32) | (uint32_t)x, player.priority, queued[i].player_id, i};
+            arrivals[fill[y >> shift]++] = arrival;
+        }
+    }
+    if (arrivals.empty()) {
+        return;
+    }
+
+    if (winners.size() < strips) {
+        winners.resize(strips);
+    }
+    if (strips == 1) {
+        resolveStrip(board, 0);
+    } else {
+        pool->parallelFor(strips, [this, &board](size_t s) { resolveStrip(board, s); });
+    }
+
+    // Collections touch shared item state, so they happen here, in strip
+    // order and as one batch; no two winners share a cell
+    board.version++;
+    collecting.clear();
+    for (size_t s = 0; s < strips; ++s) {
+        collecting.insert(collecting.end(), winners[s].begin(), winners[s].end());
+        winners[s].clear();
+    }
+    collectUnderEach(board, collecting);
+}
+
+void MoveResolver::resolveStrip(GameBoard& board, size_t strip) {
+    TRACE_ZONE("resolve_strip");
+    // Everyone moves; only arrivals on cells with items need ordering, so
+    // they are packed at the front of the strip and sorted on their own
+    Arrival* first = &arrivals[0] + strip_start[strip];
+    Arrival* last = &arrivals[0] + strip_start[strip + 1];
+    Arrival* claims = first;
+    for (Arrival* arrival = first; arrival != last; ++arrival) {
+        Player& player = board.players[arrival->player_id];
+        player.x = (int)(uint32_t)arrival->cell;
+        player.y = (int)(arrival->cell >> 32);
+        outcome[arrival->index] = 1;
+        if (board.hasItemsAt(player.x, player.y)) {
+            *claims++ = *arrival;
+        }
+    }
+    sort(first, claims, [](const Arrival& a, const Arrival& b) {
+        if (a.cell != b.cell) {
+            return a.cell < b.cell;
+        }
+        if (a.priority != b.priority) {
+            return a.priority > b.priority;
+        }
+        return a.player_id < b.player_id;
+    });
+
+    uint64_t contested = 0;
+    for (Arrival* group = first; group != claims;) {
+        Arrival* end = group + 1;
+        while (end != claims && end->cell == group->cell) {
+            ++end;
+        }
+        winners[strip].push_back(group->player_id);
+        contested += end - group > 1;
+        group = end;
+    }
+    if (contested) {
+        contests.fetch_add(contested, memory_order_relaxed);
+    }
+}
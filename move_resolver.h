@@ -0,0 +1,81 @@
+#ifndef MOVE_RESOLVER_H
+#define MOVE_RESOLVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "game_board.h"
+#include "thread_pool.h"
+
+// Applies one tick's moves as a batch, with an outcome that doesn't depend
+// on the order the moves arrived in or on the number of threads.
+//
+// A player's moves are taken in the order they were added, one per step;
+// within a step every player moves at once. When several players land on
+// the same cell with items on it, the one with the highest priority takes
+// them all, the lowest player number breaking ties, and priorities are
+// those from before the step.
+//
+// Each step is split into strips of board rows by destination cell, so
+// every contest happens inside one strip. With a pool, strips are resolved
+// in parallel and the winners' collections are applied after, in strip
+// order; players crossing a strip boundary are simply bucketed by where
+// they end up.
+class MoveResolver {
+public:
+    MoveResolver() : contests(0) {}
+
+    // Queue a move for this tick; dir is 0-3 as in DIR_DX/DIR_DY. Returns
+    // the move's index for moved().
+    size_t add(int player_id, int dir);
+
+    size_t size() const { return queued.size(); }
+
+    // Apply every queued move to board and start a new batch. Strips run
+    // on pool, the calling thread taking some too, when there are enough
+    // moves to make it worth it. Returns the number of moves that changed
+    // a player's position.
+    size_t resolve(GameBoard& board, ThreadPool* pool = nullptr);
+
+    // Whether move i of the last resolve() changed its player's position
+    bool moved(size_t i) const { return i < outcome.size() && outcome[i]; }
+
+    // Cells where more than one player arrived at items, over all ticks
+    uint64_t contested() const { return contests.load(std::memory_order_relaxed); }
+
+private:
+    MoveResolver(const MoveResolver&);
+    MoveResolver& operator=(const MoveResolver&);
+
+    struct Queued {
+        int player_id;
+        int dir;
+    };
+
+    // One move of a step, bucketed by the strip of its destination
+    struct Arrival {
+        uint64_t cell;      // y << 32 | x of the destination
+        int priority;
+        int player_id;
+        size_t index;       // Position in queued
+    };
+
+    static const size_t PARALLEL_MIN_MOVES = 1024;
+    static const int MIN_STRIP_SHIFT = 6;
+
+    void resolveStep(GameBoard& board, const std::vector<size_t>& step, ThreadPool* pool);
+    void resolveStrip(GameBoard& board, size_t strip);
+
+    std::vector<Queued> queued;
+    std::vector<uint8_t> outcome;
+    std::vector<int> player_steps;                // Moves seen per player while splitting steps
+    std::vector<std::vector<size_t> > steps;      // Indices into queued, per step
+    std::vector<Arrival> arrivals;                // The current step, grouped by strip
+    std::vector<size_t> strip_start;              // Strip s is arrivals[strip_start[s] .. strip_start[s + 1])
+    std::vector<std::vector<int> > winners;       // Players collecting, per strip
+    std::vector<int> collecting;                  // All strips' winners, in strip order
+    std::atomic<uint64_t> contests;
+};
+
+#endif // MOVE_RESOLVER_H
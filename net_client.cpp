@@ -0,0 +1,264 @@
+#include "net_client.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "log.h"
+
+using namespace std;
+
+ServerConnection::ServerConnection() : sock(-1), received(0), frames(0) {}
+
+ServerConnection::~ServerConnection() {
+    if (sock >= 0) {
+        close(sock);
+    }
+}
+
+bool ServerConnection::connect(const string& address) {
+    size_t colon = address.rfind(':');
+    if (colon == string::npos) {
+        LOG_ERROR("Expected host:port, got {}", address);
+        return false;
+    }
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &results);
+    if (err != 0) {
+        LOG_ERROR("Can't resolve {}: {}", address, gai_strerror(err));
+        return false;
+    }
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock < 0) {
+            continue;
+        }
+        if (::connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(results);
+    if (sock < 0) {
+        LOG_ERROR("Can't connect to {}: {}", address, strerror(errno));
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+bool ServerConnection::waitForWelcome(ClientGame& game, int timeout_ms) {
+    typedef chrono::steady_clock Clock;
+    Clock::time_point deadline = Clock::now() + chrono::milliseconds(timeout_ms);
+    while (!game.board) {
+        int left = (int)chrono::duration_cast<chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0) {
+            LOG_ERROR("Timed out waiting for the server");
+            return false;
+        }
+        pollfd pfd = {sock, POLLIN, 0};
+        poll(&pfd, 1, left);
+        if (!receive(game)) {
+            LOG_ERROR("Lost the connection to the server");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ServerConnection::receive(ClientGame& game) {
+    uint8_t buf[16384];
+    bool open = true;
+    for (;;) {
+        ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n > 0) {
+            in.insert(in.end(), buf, buf + n);
+            received += (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            open = false;  // Still apply what arrived before the close
+        }
+        break;
+    }
+
+    size_t pos = 0;
+    NetFrame frame;
+    long length;
+    while ((length = parseFrame(in.data() + pos, in.size() - pos, frame)) > 0) {
+        pos += (size_t)length;
+        frames++;
+        if (!applyServerFrame(frame, game)) {
+            return false;
+        }
+    }
+    in.erase(in.begin(), in.begin() + pos);
+    return open && length >= 0;
+}
+
+bool ServerConnection::sendInput(int dir) {
+    encodeInput(out, dir);
+    while (!out.empty()) {
+        ssize_t n = send(sock, &out[0], out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            out.erase(out.begin(), out.begin() + n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// Fingerprint of a mirrored board, to check that every client agrees
+uint64_t boardFingerprint(const GameBoard& board) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const auto& player : board.players) {
+        hash = (hash ^ (uint64_t)player.x) * 1099511628211ULL;
+        hash = (hash ^ (uint64_t)player.y) * 1099511628211ULL;
+        hash = (hash ^ (uint64_t)player.score) * 1099511628211ULL;
+    }
+    return (hash ^ (uint64_t)board.items_remaining) * 1099511628211ULL;
+}
+
+struct LoadClient {
+    ServerConnection conn;
+    ClientGame game;
+    bool open;
+};
+
+}
+
+int runLoadClients(const LoadClientOptions& opts, const atomic<bool>& running) {
+    typedef chrono::steady_clock Clock;
+    vector<unique_ptr<LoadClient> > clients;
+    for (int i = 0; i < opts.clients; ++i) {
+        unique_ptr<LoadClient> client(new LoadClient());
+        if (!client->conn.connect(opts.address) || !client->conn.waitForWelcome(client->game, 5000)) {
+            LOG_ERROR("Client {} failed to join", i);
+            return 1;
+        }
+        client->open = true;
+        clients.push_back(move(client));
+    }
+    int players = 0;
+    for (const auto& client : clients) {
+        players += client->game.player_id != NET_NO_PLAYER;
+    }
+    cout << clients.size() << " clients connected (" << players << " players, "
+         << clients.size() - players << " spectators)" << endl;
+
+    mt19937 gen(opts.seed);
+    vector<pollfd> fds(clients.size());
+    for (size_t i = 0; i < clients.size(); ++i) {
+        fds[i].fd = clients[i]->conn.fd();
+        fds[i].events = POLLIN;
+    }
+
+    // Send moves until the game is over or time runs out, then keep
+    // receiving briefly so every mirror catches up with the last tick
+    const Clock::duration input_interval = chrono::microseconds(1000000 / max(1, opts.input_rate));
+    const Clock::duration settle = chrono::milliseconds(500);
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + chrono::seconds(opts.seconds);
+    Clock::time_point next_input = start;
+    bool settling = false;
+    uint64_t inputs = 0;
+
+    while (running) {
+        Clock::time_point now = Clock::now();
+        if (!settling && (now >= end || clients[0]->game.board->items_remaining == 0)) {
+            settling = true;
+            end = now + settle;
+        }
+        if (settling && now >= end) {
+            break;
+        }
+
+        Clock::time_point wake = settling ? end : min(end, next_input);
+        int timeout = wake > now ? (int)chrono::duration_cast<chrono::milliseconds>(wake - now).count() + 1 : 0;
+        if (poll(&fds[0], fds.size(), timeout) > 0) {
+            for (size_t i = 0; i < clients.size(); ++i) {
+                if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && clients[i]->open &&
+                    !clients[i]->conn.receive(clients[i]->game)) {
+                    clients[i]->open = false;
+                    fds[i].fd = -1;
+                }
+            }
+        }
+
+        now = Clock::now();
+        if (!settling && now >= next_input) {
+            for (auto& client : clients) {
+                if (client->open && client->game.player_id != NET_NO_PLAYER) {
+                    client->open = client->conn.sendInput(gen() % 4);
+                    inputs++;
+                }
+            }
+            next_input += input_interval;
+            if (now > next_input) {
+                next_input = now + input_interval;
+            }
+        }
+    }
+
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    size_t open = 0;
+    bool consistent = true;
+    uint64_t fingerprint = 0;
+    uint32_t last_tick = 0;
+    for (const auto& client : clients) {
+        bytes += client->conn.bytesReceived();
+        frames += client->conn.framesReceived();
+        if (!client->open) {
+            continue;
+        }
+        uint64_t f = boardFingerprint(*client->game.board);
+        if (open++ == 0) {
+            fingerprint = f;
+            last_tick = client->game.tick;
+        } else if (f != fingerprint) {
+            consistent = false;
+        }
+    }
+    const GameBoard& board = *clients[0]->game.board;
+
+    cout << "elapsed: " << seconds << " s\n"
+         << "inputs sent: " << inputs << "\n"
+         << "frames received: " << frames << "\n"
+         << "bytes received: " << bytes << " (" << bytes / seconds / clients.size()
+         << " bytes/s per client)\n"
+         << "last tick: " << last_tick << ", items remaining: " << board.items_remaining << "\n"
+         << "connected at end: " << open << " of " << clients.size() << "\n"
+         << "mirrors consistent: " << (consistent ? "yes" : "no") << endl;
+    return consistent && open == clients.size() ? 0 : 1;
+}
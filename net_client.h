@@ -0,0 +1,60 @@
+#ifndef NET_CLIENT_H
+#define NET_CLIENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "net_protocol.h"
+
+// Client end of a connection to the game server. One thread may call
+// receive() while another calls sendInput().
+class ServerConnection {
+public:
+    ServerConnection();
+    ~ServerConnection();
+
+    // Connect to "host:port"; prints the reason and returns false on failure
+    bool connect(const std::string& address);
+
+    int fd() const { return sock; }
+
+    // Block until the server's WELCOME has been applied to game
+    bool waitForWelcome(ClientGame& game, int timeout_ms);
+
+    // Apply every complete frame that has arrived. Doesn't block; returns
+    // false once the connection is closed or the stream is corrupt.
+    bool receive(ClientGame& game);
+
+    // Queue a move; returns false if the connection is gone. Anything the
+    // socket doesn't take right away goes out with the next call.
+    bool sendInput(int dir);
+
+    uint64_t bytesReceived() const { return received; }
+    uint64_t framesReceived() const { return frames; }
+
+private:
+    ServerConnection(const ServerConnection&);
+    ServerConnection& operator=(const ServerConnection&);
+
+    int sock;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    uint64_t received;
+    uint64_t frames;
+};
+
+struct LoadClientOptions {
+    std::string address;
+    int clients;
+    int input_rate;   // Moves per second per client
+    int seconds;      // Give up after this long if the game isn't over
+    uint32_t seed;
+};
+
+// Run many headless clients from one thread: each connects, mirrors the
+// board and sends random moves. Prints traffic totals and whether every
+// mirror ended up with the same board. Returns a process exit code.
+int runLoadClients(const LoadClientOptions& opts, const std::atomic<bool>& running);
+
+#endif // NET_CLIENT_H
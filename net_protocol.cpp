@@ -0,0 +1,285 @@
+#include "net_protocol.h"
+
+using namespace std;
+
+namespace {
+
+void putU8(vector<uint8_t>& out, uint8_t v) {
+    out.push_back(v);
+}
+
+void putU16(vector<uint8_t>& out, uint16_t v) {
+    out.push_back((uint8_t)v);
+    out.push_back((uint8_t)(v >> 8));
+}
+
+void putU32(vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back((uint8_t)(v >> (8 * i)));
+    }
+}
+
+void putU64(vector<uint8_t>& out, uint64_t v) {
+    putU32(out, (uint32_t)v);
+    putU32(out, (uint32_t)(v >> 32));
+}
+
+// Start a frame; finishFrame fills in the length once the payload is done
+size_t beginFrame(vector<uint8_t>& out, NetMessageType type) {
+    size_t start = out.size();
+    putU32(out, 0);
+    putU8(out, (uint8_t)type);
+    return start;
+}
+
+void finishFrame(vector<uint8_t>& out, size_t start) {
+    uint32_t length = (uint32_t)(out.size() - start - NET_FRAME_HEADER);
+    for (int i = 0; i < 4; ++i) {
+        out[start + i] = (uint8_t)(length >> (8 * i));
+    }
+}
+
+// Bounds-checked reads; once a read runs past the end, ok stays false
+struct Reader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok;
+
+    explicit Reader(const NetFrame& frame) : p(frame.payload), end(frame.payload + frame.size), ok(true) {}
+
+    bool has(size_t n) {
+        if ((size_t)(end - p) < n) {
+            ok = false;
+        }
+        return ok;
+    }
+
+    uint8_t u8() {
+        return has(1) ? *p++ : 0;
+    }
+
+    uint16_t u16() {
+        if (!has(2)) return 0;
+        uint16_t v = (uint16_t)(p[0] | (p[1] << 8));
+        p += 2;
+        return v;
+    }
+
+    uint32_t u32() {
+        if (!has(4)) return 0;
+        uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        p += 4;
+        return v;
+    }
+
+    uint64_t u64() {
+        uint64_t lo = u32();
+        return lo | ((uint64_t)u32() << 32);
+    }
+};
+
+void putPlayer(vector<uint8_t>& out, uint32_t id, const Player& player) {
+    putU32(out, id);
+    putU32(out, (uint32_t)player.x);
+    putU32(out, (uint32_t)player.y);
+    putU32(out, (uint32_t)player.score);
+}
+
+bool readPlayer(Reader& in, GameBoard& board) {
+    uint32_t id = in.u32();
+    uint32_t x = in.u32();
+    uint32_t y = in.u32();
+    uint32_t score = in.u32();
+    if (!in.ok || id >= board.players.size() || x >= (uint32_t)board.board_size || y >= (uint32_t)board.board_size) {
+        return false;
+    }
+    Player& player = board.players[id];
+    player.x = (int)x;
+    player.y = (int)y;
+    if ((int)score != player.score) {
+        player.score = (int)score;
+        player.priority = player.score + 1;
+    }
+    board.version++;
+    return true;
+}
+
+bool applyWelcome(const NetFrame& frame, ClientGame& client) {
+    Reader in(frame);
+    if (in.u16() != NET_PROTOCOL_VERSION) {
+        return false;
+    }
+    client.player_id = in.u32();
+    client.info.seed = in.u32();
+    client.info.board_size = (int)in.u32();
+    client.info.num_players = (int)in.u32();
+    client.info.num_items = (int)in.u32();
+    client.tick = in.u32();
+    const BoardInfo& info = client.info;
+    if (!in.ok || info.board_size <= 0 || info.board_size > MAX_BOARD_SIZE ||
+        info.num_players <= 0 || info.num_items < 0 ||
+        !in.has((size_t)info.num_players * 16)) {
+        return false;
+    }
+
+    client.board.reset(new GameBoard(info.seed, info.board_size, info.num_players, info.num_items));
+    GameBoard& board = *client.board;
+    for (int i = 0; i < info.num_players; ++i) {
+        if (!readPlayer(in, board)) {
+            return false;
+        }
+    }
+    size_t words = board.items.wordCount();
+    for (size_t w = 0; w < words; ++w) {
+        uint64_t bits = in.u64();
+        for (; bits; bits &= bits - 1) {
+            size_t i = w * 64 + (size_t)__builtin_ctzll(bits);
+            if (i < board.items.size()) {
+                board.removeItem((int)i);
+            }
+        }
+    }
+    return in.ok;
+}
+
+bool applyDelta(const NetFrame& frame, ClientGame& client) {
+    if (!client.board) {
+        return false;
+    }
+    GameBoard& board = *client.board;
+    Reader in(frame);
+    client.tick = in.u32();
+    uint32_t num_players = in.u32();
+    for (uint32_t i = 0; i < num_players; ++i) {
+        if (!readPlayer(in, board)) {
+            return false;
+        }
+    }
+    uint32_t num_items = in.u32();
+    for (uint32_t i = 0; i < num_items; ++i) {
+        uint32_t item = in.u32();
+        if (!in.ok || item >= board.items.size()) {
+            return false;
+        }
+        if (!board.removeItem((int)item)) {
+            board.restoreItem((int)item);
+        }
+    }
+    return in.ok;
+}
+
+}
+
+long parseFrame(const uint8_t* data, size_t size, NetFrame& frame) {
+    if (size < NET_FRAME_HEADER) {
+        return 0;
+    }
+    uint32_t length = (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                      ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    if (length > NET_MAX_PAYLOAD) {
+        return -1;
+    }
+    if (size < NET_FRAME_HEADER + length) {
+        return 0;
+    }
+    frame.type = data[4];
+    frame.payload = data + NET_FRAME_HEADER;
+    frame.size = length;
+    return (long)(NET_FRAME_HEADER + length);
+}
+
+void encodeWelcome(vector<uint8_t>& out, const BoardInfo& info, uint32_t player_id,
+                   uint32_t tick, const GameBoard& board) {
+    size_t start = beginFrame(out, NET_WELCOME);
+    putU16(out, NET_PROTOCOL_VERSION);
+    putU32(out, player_id);
+    putU32(out, info.seed);
+    putU32(out, (uint32_t)info.board_size);
+    putU32(out, (uint32_t)info.num_players);
+    putU32(out, (uint32_t)info.num_items);
+    putU32(out, tick);
+    for (size_t i = 0; i < board.players.size(); ++i) {
+        putPlayer(out, (uint32_t)i, board.players[i]);
+    }
+    const uint64_t* collected = board.items.collectedData();
+    for (size_t w = 0; w < board.items.wordCount(); ++w) {
+        putU64(out, collected[w]);
+    }
+    finishFrame(out, start);
+}
+
+void encodeInput(vector<uint8_t>& out, int dir) {
+    size_t start = beginFrame(out, NET_INPUT);
+    putU8(out, (uint8_t)dir);
+    finishFrame(out, start);
+}
+
+bool decodeInput(const NetFrame& frame, int& dir) {
+    if (frame.type != NET_INPUT || frame.size != 1 || frame.payload[0] > 3) {
+        return false;
+    }
+    dir = frame.payload[0];
+    return true;
+}
+
+DeltaEncoder::DeltaEncoder(const GameBoard& board) :
+    prev_players(board.players),
+    prev_collected(board.items.collectedData(), board.items.collectedData() + board.items.wordCount()) {}
+
+bool DeltaEncoder::encode(const GameBoard& board, uint32_t tick, vector<uint8_t>& out) {
+    size_t start = beginFrame(out, NET_DELTA);
+    putU32(out, tick);
+
+    size_t count_at = out.size();
+    putU32(out, 0);
+    uint32_t players = 0;
+    for (size_t i = 0; i < board.players.size(); ++i) {
+        const Player& now = board.players[i];
+        Player& prev = prev_players[i];
+        if (now.x != prev.x || now.y != prev.y || now.score != prev.score) {
+            putPlayer(out, (uint32_t)i, now);
+            prev = now;
+            players++;
+        }
+    }
+    for (int b = 0; b < 4; ++b) {
+        out[count_at + b] = (uint8_t)(players >> (8 * b));
+    }
+
+    count_at = out.size();
+    putU32(out, 0);
+    uint32_t items = 0;
+    const uint64_t* collected = board.items.collectedData();
+    for (size_t w = 0; w < prev_collected.size(); ++w) {
+        uint64_t flipped = collected[w] ^ prev_collected[w];
+        if (!flipped) {
+            continue;
+        }
+        prev_collected[w] = collected[w];
+        for (; flipped; flipped &= flipped - 1) {
+            putU32(out, (uint32_t)(w * 64 + __builtin_ctzll(flipped)));
+            items++;
+        }
+    }
+    for (int b = 0; b < 4; ++b) {
+        out[count_at + b] = (uint8_t)(items >> (8 * b));
+    }
+
+    if (players == 0 && items == 0) {
+        out.resize(start);
+        return false;
+    }
+    finishFrame(out, start);
+    return true;
+}
+
+bool applyServerFrame(const NetFrame& frame, ClientGame& client) {
+    switch (frame.type) {
+    case NET_WELCOME:
+        return !client.board && applyWelcome(frame, client);
+    case NET_DELTA:
+        return applyDelta(frame, client);
+    default:
+        return false;
+    }
+}
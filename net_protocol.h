@@ -0,0 +1,86 @@
+#ifndef NET_PROTOCOL_H
+#define NET_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "game_board.h"
+
+// Wire format between the game server and its clients. Every message is a
+// frame of [u32 payload length][u8 type][payload], little endian.
+//
+//   WELCOME  server -> client, once. Protocol version, the client's player
+//            id (NET_NO_PLAYER for spectators), the board's seed, size,
+//            player and item counts, the current tick, every player's
+//            position and score, and the collected-item bitset. The client
+//            rebuilds the board from the seed and applies the rest.
+//   DELTA    server -> client, after each tick that changed something.
+//            The tick, the players whose position or score changed, and
+//            the items collected or respawned during the tick (each one
+//            flips).
+//   INPUT    client -> server. One move direction, 0-3 as in DIR_DX/DIR_DY.
+const uint16_t NET_PROTOCOL_VERSION = 4;  // 2: 32-bit player positions; 3: banded item placement;
+                                          // 4: respawned items in deltas
+const uint32_t NET_NO_PLAYER = 0xFFFFFFFF;
+const size_t NET_FRAME_HEADER = 5;
+const uint32_t NET_MAX_PAYLOAD = 1 << 24;
+
+enum NetMessageType {
+    NET_WELCOME = 1,
+    NET_DELTA = 2,
+    NET_INPUT = 3,
+};
+
+// What a client needs to rebuild the server's board from scratch
+struct BoardInfo {
+    uint32_t seed;
+    int board_size;
+    int num_players;
+    int num_items;
+};
+
+// One frame inside a receive buffer; payload points into that buffer
+struct NetFrame {
+    uint8_t type;
+    const uint8_t* payload;
+    size_t size;
+};
+
+// Parse the frame at the start of data. Returns its total length, 0 if the
+// frame isn't complete yet, or -1 if the stream is corrupt.
+long parseFrame(const uint8_t* data, size_t size, NetFrame& frame);
+
+void encodeWelcome(std::vector<uint8_t>& out, const BoardInfo& info, uint32_t player_id,
+                   uint32_t tick, const GameBoard& board);
+void encodeInput(std::vector<uint8_t>& out, int dir);
+bool decodeInput(const NetFrame& frame, int& dir);
+
+// Server side. Remembers what clients have seen and encodes the difference.
+class DeltaEncoder {
+public:
+    explicit DeltaEncoder(const GameBoard& board);
+
+    // Append a DELTA frame with everything that changed since the last call;
+    // returns false (and appends nothing) if nothing did
+    bool encode(const GameBoard& board, uint32_t tick, std::vector<uint8_t>& out);
+
+private:
+    std::vector<Player> prev_players;
+    std::vector<uint64_t> prev_collected;
+};
+
+// Client side mirror of the server's board
+struct ClientGame {
+    uint32_t player_id;
+    uint32_t tick;
+    BoardInfo info;
+    std::unique_ptr<GameBoard> board;
+
+    ClientGame() : player_id(NET_NO_PLAYER), tick(0) {}
+};
+
+// Apply a frame from the server; false if it is malformed or unexpected
+bool applyServerFrame(const NetFrame& frame, ClientGame& client);
+
+#endif // NET_PROTOCOL_H
@@ -0,0 +1,401 @@
+#include "render.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "metrics.h"
+#include "trace.h"
+
+using namespace std;
+
+SDL_Window* window = nullptr;
+SDL_Renderer* renderer = nullptr;
+
+const Color PLAYER_COLORS[NUM_PLAYER_COLORS] = {
+    Color(255, 0, 0),      // Red
+    Color(0, 0, 255),      // Blue
+    Color(255, 140, 0),    // Orange
+    Color(128, 0, 128),    // Purple
+    Color(0, 128, 128),    // Teal
+    Color(255, 20, 147),   // Pink
+    Color(139, 69, 19),    // Brown
+    Color(0, 0, 0),        // Black
+};
+
+const Color& playerColor(int index) {
+    return PLAYER_COLORS[index % NUM_PLAYER_COLORS];
+}
+
+// Strokes of each digit as lines between two points, endpoints included.
+// Coordinates are in steps across the digit: 0, 1 and 2 are its start,
+// middle and end, and 3 is its last pixel, where SDL_RenderDrawRect puts
+// the edge of a box. -1 ends a list.
+const signed char DIGIT_STROKES[10][MAX_DIGIT_STROKES + 1][4] = {
+    // 0: rectangle
+    {{0, 0, 3, 0}, {0, 3, 3, 3}, {0, 0, 0, 3}, {3, 0, 3, 3}, {-1}},
+    // 1: vertical line
+    {{1, 0, 1, 2}, {-1}},
+    // 2: top, middle, bottom, top right, bottom left
+    {{0, 0, 2, 0}, {0, 1, 2, 1}, {0, 2, 2, 2}, {2, 0, 2, 1}, {0, 1, 0, 2}, {-1}},
+    // 3: three horizontals, right vertical
+    {{0, 0, 2, 0}, {0, 1, 2, 1}, {0, 2, 2, 2}, {2, 0, 2, 2}, {-1}},
+    // 4: top left vertical, middle, right vertical
+    {{0, 0, 0, 1}, {0, 1, 2, 1}, {2, 0, 2, 2}, {-1}},
+    // 5: three horizontals, top left, bottom right
+    {{0, 0, 2, 0}, {0, 1, 2, 1}, {0, 2, 2, 2}, {0, 0, 0, 1}, {2, 1, 2, 2}, {-1}},
+    // 6: three horizontals, left vertical, bottom right
+    {{0, 0, 2, 0}, {0, 1, 2, 1}, {0, 2, 2, 2}, {0, 0, 0, 2}, {2, 1, 2, 2}, {-1}},
+    // 7: top, right vertical
+    {{0, 0, 2, 0}, {2, 0, 2, 2}, {-1}},
+    // 8: rectangle and middle
+    {{0, 0, 3, 0}, {0, 3, 3, 3}, {0, 0, 0, 3}, {3, 0, 3, 3}, {0, 1, 2, 1}, {-1}},
+    // 9: top, middle, right vertical, top left
+    {{0, 0, 2, 0}, {0, 1, 2, 1}, {2, 0, 2, 2}, {0, 0, 0, 1}, {-1}},
+};
+
+int strokeAt(int step, int start, int size) {
+    switch (step) {
+        case 0: return start;
+        case 1: return start + size / 2;
+        case 2: return start + size;
+        default: return start + size - 1;
+    }
+}
+
+int digitStrokes(int digit, int x, int y, int width, int height, DigitStroke* out) {
+    int count = 0;
+    for (const auto& stroke : DIGIT_STROKES[digit]) {
+        if (stroke[0] < 0) {
+            break;
+        }
+        out[count].x1 = strokeAt(stroke[0], x, width);
+        out[count].y1 = strokeAt(stroke[1], y, height);
+        out[count].x2 = strokeAt(stroke[2], x, width);
+        out[count].y2 = strokeAt(stroke[3], y, height);
+        count++;
+    }
+    return count;
+}
+
+void drawDigit(int digit, int x, int y, int width, int height) {
+    DigitStroke strokes[MAX_DIGIT_STROKES];
+    int count = digitStrokes(digit, x, y, width, height, strokes);
+    for (int i = 0; i < count; ++i) {
+        SDL_RenderDrawLine(renderer, strokes[i].x1, strokes[i].y1, strokes[i].x2, strokes[i].y2);
+    }
+}
+
+int drawNumber(unsigned long value, int x, int y, int digitWidth, int digitHeight) {
+    string digits = to_string(value);
+    for (char c : digits) {
+        drawDigit(c - '0', x, y, digitWidth, digitHeight);
+        x += digitWidth + digitWidth / 4;
+    }
+    return x;
+}
+
+// Update renderScore function to use the digit drawing
+void renderScore(int x, int y, int score, const Color& color) {
+    // Draw background
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+    SDL_Rect scoreBackground = {
+        x,
+        y,
+        100,
+        50
+    };
+    SDL_RenderFillRect(renderer, &scoreBackground);
+    
+    // Draw label
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_Rect labelRect = {
+        x + 5,
+        y + 10,
+        30,
+        30
+    };
+    SDL_RenderDrawRect(renderer, &labelRect);
+    
+    // Draw score digits
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    drawNumber(score, x + 45, y + 10, 20, 30);
+}
+
+RenderCache renderCache;
+
+void invalidateRenderCache() {
+    if (renderCache.grid) {
+        SDL_DestroyTexture(renderCache.grid);
+        renderCache.grid = nullptr;
+    }
+    if (renderCache.hud) {
+        SDL_DestroyTexture(renderCache.hud);
+        renderCache.hud = nullptr;
+    }
+    renderCache.hudScores.clear();
+    renderCache.dirty = true;
+}
+
+SDL_Rect cellRect(int x, int y, int cellSize) {
+    SDL_Rect rect = {
+        x * cellSize + CELL_PADDING,
+        y * cellSize + CELL_PADDING,
+        cellSize - 2*CELL_PADDING,
+        cellSize - 2*CELL_PADDING
+    };
+    return rect;
+}
+
+// Background and grid lines, into the current render target
+void drawGrid(int boardSize, int cellSize) {
+    SDL_SetRenderDrawColor(renderer, BG_COLOR.r, BG_COLOR.g, BG_COLOR.b, 255);
+    SDL_RenderClear(renderer);
+    SDL_SetRenderDrawColor(renderer, GRID_COLOR.r, GRID_COLOR.g, GRID_COLOR.b, 255);
+    for (int i = 0; i <= boardSize; i++) {
+        SDL_RenderDrawLine(renderer, i * cellSize, 0, i * cellSize, SCREEN_SIZE);
+        SDL_RenderDrawLine(renderer, 0, i * cellSize, SCREEN_SIZE, i * cellSize);
+    }
+}
+
+vector<pair<int, int> > hudScores(const vector<Player>& players) {
+    vector<pair<int, int> > scores;
+    if (players.size() <= MAX_HUD_SCORES) {
+        for (size_t i = 0; i < players.size(); ++i) {
+            scores.push_back(make_pair((int)i, players[i].score));
+        }
+    } else {
+        vector<int> leaders = leadingPlayers(players, MAX_HUD_SCORES);
+        for (size_t i = 0; i < leaders.size(); ++i) {
+            scores.push_back(make_pair(leaders[i], players[leaders[i]].score));
+        }
+    }
+    return scores;
+}
+
+// Score boxes across the top, into the current render target
+void drawScores(const vector<pair<int, int> >& scores) {
+    int step = scores.size() > 1 ? (SCREEN_SIZE - 120) / (int)(scores.size() - 1) : 0;
+    for (size_t i = 0; i < scores.size(); ++i) {
+        renderScore(10 + (int)i * step, 10, scores[i].second, playerColor(scores[i].first));
+    }
+}
+
+StatsOverlay::StatsOverlay() : visible(false), updatedAt(0), lastMessages(0) {
+    memset(rows, 0, sizeof(rows));
+}
+
+StatsOverlay statsOverlay;
+const Uint32 STATS_REFRESH_MS = 500;
+
+bool updateStatsOverlay(Uint32 now, unsigned long dropped) {
+    if (now - statsOverlay.updatedAt < STATS_REFRESH_MS) {
+        return false;
+    }
+    double seconds = (now - statsOverlay.updatedAt) / 1000.0;
+    uint64_t messages = metrics.messages.load();
+    unsigned long rows[3][3] = {
+        {(unsigned long)(metrics.inputToPhoton.percentile(50) / 1000),
+         (unsigned long)(metrics.inputToPhoton.percentile(99) / 1000),
+         (unsigned long)(metrics.inputToPhoton.percentile(99.9) / 1000)},
+        {(unsigned long)(metrics.frameTime.percentile(50) / 1000),
+         (unsigned long)(metrics.frameTime.percentile(99) / 1000),
+         (unsigned long)(metrics.frameTime.percentile(99.9) / 1000)},
+        {(unsigned long)((messages - statsOverlay.lastMessages) / seconds),
+         dropped,
+         (unsigned long)metrics.coalesced.load()},
+    };
+    statsOverlay.updatedAt = now;
+    statsOverlay.lastMessages = messages;
+    if (memcmp(rows, statsOverlay.rows, sizeof(rows)) == 0) {
+        return false;
+    }
+    memcpy(statsOverlay.rows, rows, sizeof(rows));
+    return true;
+}
+
+void drawStatsOverlay() {
+    const Color ROW_COLORS[3] = {Color(0, 200, 0), Color(0, 120, 255), Color(255, 140, 0)};
+    const int ROW_HEIGHT = 30;
+    SDL_Rect panel = {10, SCREEN_SIZE - 10 - 3 * ROW_HEIGHT - 10, 420, 3 * ROW_HEIGHT + 10};
+    SDL_SetRenderDrawColor(renderer, 40, 40, 40, 255);
+    SDL_RenderFillRect(renderer, &panel);
+    
+    for (int row = 0; row < 3; ++row) {
+        int y = panel.y + 8 + row * ROW_HEIGHT;
+        SDL_Rect marker = {panel.x + 8, y + 2, 12, 12};
+        SDL_SetRenderDrawColor(renderer, ROW_COLORS[row].r, ROW_COLORS[row].g, ROW_COLORS[row].b, 255);
+        SDL_RenderFillRect(renderer, &marker);
+        
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        for (int col = 0; col < 3; ++col) {
+            drawNumber(statsOverlay.rows[row][col], panel.x + 35 + col * 130, y, 9, 16);
+        }
+    }
+}
+
+// Render into a new target texture with draw(); null if the renderer
+// doesn't support render targets
+template <typename Draw>
+SDL_Texture* renderToTexture(int width, int height, Draw draw) {
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                             SDL_TEXTUREACCESS_TARGET, width, height);
+    if (!texture) {
+        return nullptr;
+    }
+    if (SDL_SetRenderTarget(renderer, texture) != 0) {
+        SDL_DestroyTexture(texture);
+        return nullptr;
+    }
+    draw();
+    SDL_SetRenderTarget(renderer, nullptr);
+    return texture;
+}
+
+bool renderGame(const GameSnapshot& snapshot, bool gameOver) {
+    if (!renderCache.dirty && renderCache.presentedVersion == snapshot.version &&
+        renderCache.gameOverShown == gameOver) {
+        return false;  // Nothing changed since the last frame
+    }
+    TRACE_ZONE("render_game");
+    
+    // On big boards only the camera's view is drawn, scaled to the window
+    int viewSize = snapshot.view_size;
+    int viewX = snapshot.view_x;
+    int viewY = snapshot.view_y;
+    int CELL_SIZE = SCREEN_SIZE / viewSize;
+    
+    // Draw grid
+    if (!renderCache.grid || renderCache.gridViewSize != viewSize) {
+        if (renderCache.grid) {
+            SDL_DestroyTexture(renderCache.grid);
+        }
+        renderCache.grid = renderToTexture(SCREEN_SIZE, SCREEN_SIZE, [viewSize, CELL_SIZE]() {
+            drawGrid(viewSize, CELL_SIZE);
+        });
+        renderCache.gridViewSize = viewSize;
+    }
+    if (renderCache.grid) {
+        SDL_RenderCopy(renderer, renderCache.grid, nullptr, nullptr);
+    } else {
+        drawGrid(viewSize, CELL_SIZE);
+    }
+    
+    // Draw items
+    if (renderCache.itemRectsVersion != snapshot.items_version) {
+        renderCache.itemRects.clear();
+        for (const auto& item : snapshot.items) {
+            renderCache.itemRects.push_back(cellRect(item.first - viewX, item.second - viewY, CELL_SIZE));
+        }
+        renderCache.itemRectsVersion = snapshot.items_version;
+    }
+    if (!renderCache.itemRects.empty()) {
+        SDL_SetRenderDrawColor(renderer, ITEM_COLOR.r, ITEM_COLOR.g, ITEM_COLOR.b, 255);
+        SDL_RenderFillRects(renderer, &renderCache.itemRects[0], (int)renderCache.itemRects.size());
+    }
+    
+    // Draw players in view, one batch per color
+    for (int c = 0; c < NUM_PLAYER_COLORS; ++c) {
+        renderCache.playerRects[c].clear();
+    }
+    const vector<Player>& players = snapshot.players;
+    for (size_t i = 0; i < players.size(); ++i) {
+        int x = players[i].x - viewX;
+        int y = players[i].y - viewY;
+        if (x >= 0 && x < viewSize && y >= 0 && y < viewSize) {
+            renderCache.playerRects[i % NUM_PLAYER_COLORS].push_back(cellRect(x, y, CELL_SIZE));
+        }
+    }
+    for (int c = 0; c < NUM_PLAYER_COLORS; ++c) {
+        const vector<SDL_Rect>& rects = renderCache.playerRects[c];
+        if (!rects.empty()) {
+            SDL_SetRenderDrawColor(renderer, PLAYER_COLORS[c].r, PLAYER_COLORS[c].g, PLAYER_COLORS[c].b, 255);
+            SDL_RenderFillRects(renderer, &rects[0], (int)rects.size());
+        }
+    }
+    
+    // Draw scores at the top of the window with labels
+    vector<pair<int, int> > scores = hudScores(players);
+    if (!renderCache.hud || scores != renderCache.hudScores) {
+        if (renderCache.hud) {
+            SDL_DestroyTexture(renderCache.hud);
+        }
+        renderCache.hud = renderToTexture(SCREEN_SIZE, HUD_HEIGHT, [&scores]() {
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
+            drawScores(scores);
+        });
+        if (renderCache.hud) {
+            SDL_SetTextureBlendMode(renderCache.hud, SDL_BLENDMODE_BLEND);
+        }
+        renderCache.hudScores = scores;
+    }
+    if (renderCache.hud) {
+        SDL_Rect hudRect = {0, 0, SCREEN_SIZE, HUD_HEIGHT};
+        SDL_RenderCopy(renderer, renderCache.hud, nullptr, &hudRect);
+    } else {
+        drawScores(scores);
+    }
+    
+    if (statsOverlay.visible) {
+        drawStatsOverlay();
+    }
+    
+    if (gameOver) {
+        // Determine winner and runner-up, shown in player order
+        vector<int> finalists = leadingPlayers(players, 2);
+        const Player* winner = &players[finalists[0]];
+        const Color& winnerColor = playerColor(finalists[0]);
+        sort(finalists.begin(), finalists.end());
+        
+        // Draw semi-transparent overlay
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 200);
+        SDL_Rect overlay = {0, 0, SCREEN_SIZE, SCREEN_SIZE};
+        SDL_RenderFillRect(renderer, &overlay);
+        
+        // Draw winner announcement box
+        SDL_SetRenderDrawColor(renderer, winnerColor.r, winnerColor.g, winnerColor.b, 255);
+        
+        // Winner box
+        SDL_Rect winnerBox = {
+            SCREEN_SIZE/4,
+            SCREEN_SIZE/3,
+            SCREEN_SIZE/2,
+            SCREEN_SIZE/3
+        };
+        SDL_RenderFillRect(renderer, &winnerBox);
+        
+        // Draw border for winner box
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        SDL_RenderDrawRect(renderer, &winnerBox);
+        
+        // Draw final scores
+        for (size_t i = 0; i < finalists.size(); ++i) {
+            renderScore(SCREEN_SIZE/4 + 50,
+                       SCREEN_SIZE/3 + 30 + 60 * (int)i,
+                       players[finalists[i]].score,
+                       playerColor(finalists[i]));
+        }
+        
+        // Draw winner text
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        string winnerText = "Player " + string(1, winner->symbol) + " Wins!";
+        
+        // Draw winner announcement
+        SDL_Rect winnerTextBox = {
+            SCREEN_SIZE/4 + 50,
+            SCREEN_SIZE/3 + 150,
+            SCREEN_SIZE/2 - 100,
+            40
+        };
+        SDL_RenderFillRect(renderer, &winnerTextBox);
+    }
+    
+    {
+        TRACE_ZONE("present");
+        SDL_RenderPresent(renderer);
+    }
+    renderCache.presentedVersion = snapshot.version;
+    renderCache.gameOverShown = gameOver;
+    renderCache.dirty = false;
+    return true;
+}
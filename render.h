@@ -0,0 +1,107 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "/opt/homebrew/Cellar/sdl2/2.30.9/include/SDL2/SDL.h"
+#include "snapshot.h"
+
+// Constants for graphics
+const int SCREEN_SIZE = 800;
+const int CELL_PADDING = 2;
+const size_t MAX_HUD_SCORES = 7;  // Score boxes that fit across the top
+extern SDL_Window* window;
+extern SDL_Renderer* renderer;
+
+// Add colors for graphics
+struct Color {
+    Uint8 r, g, b;
+    Color(Uint8 red, Uint8 green, Uint8 blue) : r(red), g(green), b(blue) {}
+};
+
+const Color ITEM_COLOR(0, 255, 0);       // Green
+const Color GRID_COLOR(200, 200, 200);   // Light Gray
+const Color BG_COLOR(255, 255, 255);     // White
+
+// Player colors, reused if there are more players than colors
+const int NUM_PLAYER_COLORS = 8;
+extern const Color PLAYER_COLORS[NUM_PLAYER_COLORS];
+
+const Color& playerColor(int index);
+
+// The lines drawDigit draws, from (x1, y1) to (x2, y2) inclusive; also
+// used by the software renderer
+struct DigitStroke {
+    int x1, y1, x2, y2;
+};
+const int MAX_DIGIT_STROKES = 5;
+
+// Fill out with the strokes of digit in the box at (x, y); returns how many
+int digitStrokes(int digit, int x, int y, int width, int height, DigitStroke* out);
+
+void drawDigit(int digit, int x, int y, int width, int height);
+
+// Draw a non-negative number with drawDigit in the current color; returns
+// the x coordinate just past the last digit
+int drawNumber(unsigned long value, int x, int y, int digitWidth, int digitHeight);
+
+void renderScore(int x, int y, int score, const Color& color);
+
+// The (player, score) pairs the HUD shows, left to right: every player,
+// or the leaders when there are more than fit
+const int HUD_HEIGHT = 70;
+std::vector<std::pair<int, int> > hudScores(const std::vector<Player>& players);
+
+// Cached render state. The grid is drawn once into a texture, the HUD is
+// re-rasterized only when the scores on it change, item rectangles are
+// rebuilt only when the items in view change, and frames where the board
+// hasn't changed are skipped entirely.
+struct RenderCache {
+    SDL_Texture* grid;
+    int gridViewSize;                 // View size the grid texture was drawn for
+    SDL_Texture* hud;
+    std::vector<std::pair<int, int> > hudScores;  // (player, score) drawn on the HUD texture
+    std::vector<SDL_Rect> itemRects;
+    unsigned long itemRectsVersion;   // Snapshot items_version itemRects was built from
+    std::vector<SDL_Rect> playerRects[NUM_PLAYER_COLORS];
+    unsigned long presentedVersion;   // Board version currently on screen
+    bool dirty;                       // Redraw even if the board hasn't changed
+    bool gameOverShown;               // The game over screen is on screen
+
+    RenderCache() : grid(nullptr), gridViewSize(0), hud(nullptr),
+                    itemRectsVersion(0), presentedVersion(0), dirty(true),
+                    gameOverShown(false) {}
+};
+
+extern RenderCache renderCache;
+
+// Drop cached textures, e.g. after the renderer lost them
+void invalidateRenderCache();
+
+// Latency overlay (--stats or F3), refreshed a couple of times a second.
+// Each row starts with a colored marker:
+//   green  - input to photon p50, p99, p99.9 in microseconds
+//   blue   - frame time p50, p99, p99.9 in microseconds
+//   orange - inputs applied per second, dropped inputs, coalesced inputs
+struct StatsOverlay {
+    bool visible;
+    unsigned long rows[3][3];
+    Uint32 updatedAt;
+    uint64_t lastMessages;
+
+    StatsOverlay();
+};
+
+extern StatsOverlay statsOverlay;
+
+// Recompute the overlay numbers from metrics if they are due; dropped is
+// the number of inputs lost so far. True if the numbers changed.
+bool updateStatsOverlay(Uint32 now, unsigned long dropped);
+
+// Draw the board as of snapshot. Once gameOver is set the game over
+// screen is drawn on top. Returns false if the frame was skipped because
+// nothing changed.
+bool renderGame(const GameSnapshot& snapshot, bool gameOver);
+
+#endif // RENDER_H
@@ -0,0 +1,230 @@
+#include "replay.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "metrics.h"
+
+using namespace std;
+
+namespace {
+
+const char REPLAY_MAGIC[4] = {'M', 'T', 'G', 'R'};
+const uint8_t REPLAY_VERSION = 5;  // 2: each tick resolved as a MoveResolver batch; 3: banded item placement;
+                                   // 4: board rules; 5: power-ups picked per seed
+
+void putVarint(vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// Bounds-checked varint read, for validating the file
+bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readVarint32(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    uint64_t v;
+    if (!readVarint(p, end, v) || v > 0xFFFFFFFFu) {
+        return false;
+    }
+    value = (uint32_t)v;
+    return true;
+}
+
+}
+
+ReplayWriter::ReplayWriter() :
+    file(nullptr), current_tick(0), last_tick(0), moves(0), handed_off_ns(0), closing(false), failed(false) {}
+
+ReplayWriter::~ReplayWriter() {
+    close();
+}
+
+bool ReplayWriter::open(const string& path, const ReplayHeader& header) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        LOG_ERROR("Can't create {}: {}", path, strerror(errno));
+        return false;
+    }
+    buffer.reserve(CHUNK_SIZE + 1024);
+    buffer.insert(buffer.end(), REPLAY_MAGIC, REPLAY_MAGIC + sizeof(REPLAY_MAGIC));
+    buffer.push_back(REPLAY_VERSION);
+    putVarint(buffer, header.seed);
+    putVarint(buffer, header.size);
+    putVarint(buffer, header.players);
+    putVarint(buffer, header.items);
+    putVarint(buffer, header.tick_rate);
+    putVarint(buffer, header.respawn_ticks);
+    putVarint(buffer, header.powerup_ticks);
+    handed_off_ns = nowNs();
+    writer = thread(&ReplayWriter::runWriter, this);
+    return true;
+}
+
+void ReplayWriter::record(uint32_t tick, int player_id, int dir) {
+    if (tick != current_tick && !tick_moves.empty()) {
+        endTick();
+    }
+    current_tick = tick;
+    tick_moves.push_back((uint32_t)player_id * 4 + (uint32_t)dir);
+    moves++;
+}
+
+void ReplayWriter::endTick() {
+    putVarint(buffer, current_tick - last_tick);
+    putVarint(buffer, tick_moves.size());
+    for (uint32_t move : tick_moves) {
+        putVarint(buffer, move);
+    }
+    last_tick = current_tick;
+    tick_moves.clear();
+    if (buffer.size() >= CHUNK_SIZE || nowNs() - handed_off_ns >= HANDOFF_INTERVAL_NS) {
+        handOff();
+    }
+}
+
+void ReplayWriter::handOff() {
+    vector<uint8_t> chunk;
+    chunk.reserve(CHUNK_SIZE + 1024);
+    chunk.swap(buffer);
+    handed_off_ns = nowNs();
+    {
+        lock_guard<std::mutex> lock(mutex);
+        chunks.push_back(move(chunk));
+    }
+    wake.notify_one();
+}
+
+void ReplayWriter::runWriter() {
+    unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this]() { return closing || !chunks.empty(); });
+        if (chunks.empty()) {
+            return;  // Closing and nothing left
+        }
+        vector<uint8_t> chunk = move(chunks.front());
+        chunks.pop_front();
+        lock.unlock();
+        // Flushed each time, so what was handed off survives a crash
+        bool ok = fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size() && fflush(file) == 0;
+        lock.lock();
+        failed = failed || !ok;
+    }
+}
+
+bool ReplayWriter::close() {
+    if (!file) {
+        return !failed;
+    }
+    if (!tick_moves.empty()) {
+        endTick();
+    }
+    if (!buffer.empty()) {
+        handOff();
+    }
+    {
+        lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    wake.notify_one();
+    writer.join();
+    failed = fclose(file) != 0 || failed;
+    file = nullptr;
+    return !failed;
+}
+
+ReplayReader::ReplayReader() :
+    mapping(nullptr), mapped_size(0), body(nullptr), pos(nullptr), valid_end(nullptr), end(nullptr),
+    num_ticks(0), num_moves(0) {
+    memset(&info, 0, sizeof(info));
+}
+
+ReplayReader::~ReplayReader() {
+    if (mapping) {
+        munmap(mapping, mapped_size);
+    }
+}
+
+bool ReplayReader::open(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Can't open {}: {}", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(REPLAY_MAGIC) + 1) {
+        LOG_ERROR("{} is not a replay file", path);
+        ::close(fd);
+        return false;
+    }
+    mapped_size = (size_t)st.st_size;
+    mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        LOG_ERROR("Can't map {}: {}", path, strerror(errno));
+        return false;
+    }
+    // Playback reads the file front to back exactly once
+    madvise(mapping, mapped_size, MADV_SEQUENTIAL);
+
+    const uint8_t* p = (const uint8_t*)mapping;
+    end = p + mapped_size;
+    if (memcmp(p, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0 || p[sizeof(REPLAY_MAGIC)] != REPLAY_VERSION) {
+        LOG_ERROR("{} is not a replay file (or is from another version)", path);
+        return false;
+    }
+    p += sizeof(REPLAY_MAGIC) + 1;
+    if (!readVarint32(p, end, info.seed) || !readVarint32(p, end, info.size) ||
+        !readVarint32(p, end, info.players) || !readVarint32(p, end, info.items) ||
+        !readVarint32(p, end, info.tick_rate) || !readVarint32(p, end, info.respawn_ticks) ||
+        !readVarint32(p, end, info.powerup_ticks) || info.players == 0 || info.tick_rate == 0) {
+        LOG_ERROR("{} has a bad header", path);
+        return false;
+    }
+    body = p;
+    return scan();
+}
+
+// Find the last complete tick group and count what's in the file, so
+// nextTick can decode without checking bounds
+bool ReplayReader::scan() {
+    const uint8_t* p = body;
+    valid_end = body;
+    num_ticks = 0;
+    num_moves = 0;
+    uint64_t delta, count, move;
+    while (readVarint(p, end, delta) && readVarint(p, end, count)) {
+        uint64_t i = 0;
+        for (; i < count && readVarint(p, end, move); ++i) {
+            if ((move >> 2) >= info.players) {
+                LOG_ERROR("Replay has a move for player {} of {}", (move >> 2) + 1, info.players);
+                return false;
+            }
+        }
+        if (i < count) {
+            break;
+        }
+        valid_end = p;
+        num_ticks++;
+        num_moves += count;
+    }
+    pos = body;
+    return true;
+}
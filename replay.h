@@ -0,0 +1,147 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Replay files hold everything needed to re-simulate a game: the board
+// arguments, then every applied move grouped by tick.
+//
+//   "MTGR" u8 version
+//   varint seed, size, players, items, tick_rate
+//   repeated: varint ticks since the previous group, varint move count,
+//             then one varint per move: player_id * 4 + direction
+//
+// The file is append-only and recorded ticks reach it at least once a
+// second, so a game that crashed still replays up to about a second before
+// the crash.
+
+struct ReplayHeader {
+    uint32_t seed;
+    uint32_t size;       // As passed to GameBoard: 0 = derived from the seed
+    uint32_t players;
+    uint32_t items;
+    uint32_t tick_rate;
+    uint32_t respawn_ticks;  // BoardRules the game was played with
+    uint32_t powerup_ticks;
+};
+
+// Records moves from the simulation thread. record() only appends to a
+// memory buffer; buffers are written out by a background thread when full
+// or a second old, so the game loop never waits on the disk.
+class ReplayWriter {
+public:
+    ReplayWriter();
+    ~ReplayWriter();
+
+    bool open(const std::string& path, const ReplayHeader& header);
+
+    // Log a move applied during tick; ticks must not go backwards
+    void record(uint32_t tick, int player_id, int dir);
+
+    // Write out everything recorded and close the file; false if any write
+    // failed
+    bool close();
+
+    uint64_t movesRecorded() const { return moves; }
+
+private:
+    ReplayWriter(const ReplayWriter&);
+    ReplayWriter& operator=(const ReplayWriter&);
+
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    static const uint64_t HANDOFF_INTERVAL_NS = 1000000000ULL;
+
+    void endTick();
+    void handOff();
+    void runWriter();
+
+    FILE* file;
+    std::vector<uint8_t> buffer;        // Filled by record()
+    std::vector<uint32_t> tick_moves;   // Moves of the tick being recorded
+    uint32_t current_tick;
+    uint32_t last_tick;
+    uint64_t moves;
+    uint64_t handed_off_ns;             // When buffer was last handed off
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::vector<uint8_t> > chunks;  // Waiting for the writer
+    bool closing;
+    bool failed;
+    std::thread writer;
+};
+
+// Read-only view of a replay file, mapped into memory
+class ReplayReader {
+public:
+    ReplayReader();
+    ~ReplayReader();
+
+    // Map the file and parse its header; prints the reason on failure
+    bool open(const std::string& path);
+
+    const ReplayHeader& header() const { return info; }
+
+    // Start over from the first tick
+    void rewind() { pos = body; }
+
+    uint64_t ticks() const { return num_ticks; }
+    uint64_t moves() const { return num_moves; }
+
+    // True if the file ends in the middle of a tick group, e.g. because
+    // the game crashed; playback stops at the last complete one
+    bool truncated() const { return valid_end != end; }
+
+    // Decode the next tick group, calling onMove(player_id, dir) for each
+    // move. Returns false at the end. open() has already checked every
+    // group before valid_end, so this doesn't bounds check again.
+    template <class OnMove>
+    bool nextTick(uint32_t& tick, OnMove onMove) {
+        if (pos >= valid_end) {
+            return false;
+        }
+        tick += (uint32_t)decodeVarint(pos);
+        for (uint64_t count = decodeVarint(pos); count > 0; --count) {
+            uint64_t move = decodeVarint(pos);
+            onMove((int)(move >> 2), (int)(move & 3));
+        }
+        return true;
+    }
+
+private:
+    ReplayReader(const ReplayReader&);
+    ReplayReader& operator=(const ReplayReader&);
+
+    static uint64_t decodeVarint(const uint8_t*& p) {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = *p++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+    }
+
+    bool scan();
+
+    void* mapping;
+    size_t mapped_size;
+    const uint8_t* body;
+    const uint8_t* pos;
+    const uint8_t* valid_end;  // End of the last complete tick group
+    const uint8_t* end;
+    uint64_t num_ticks;
+    uint64_t num_moves;
+    ReplayHeader info;
+};
+
+#endif // REPLAY_H
@@ -0,0 +1,126 @@
+#include "rollback.h"
+
+#include <algorithm>
+#include "trace.h"
+
+using namespace std;
+
+RollbackSimulation::RollbackSimulation(GameBoard& board, size_t max_ticks) :
+    board(board), history(max(max_ticks, (size_t)1)), next_tick(0), first_tick(0), replay_from(0),
+    ticks_replayed(0) {}
+
+uint64_t RollbackSimulation::add(uint32_t tick, int player_id, int dir) {
+    tick = max(min(tick, next_tick), first_tick);
+    vector<Move>& moves = slot(tick).moves;
+    Move move = {player_id, dir, false};
+    moves.push_back(move);
+    replay_from = min(replay_from, tick);
+    return ((uint64_t)tick << 32) | (moves.size() - 1);
+}
+
+size_t RollbackSimulation::catchUp(ThreadPool* pool) {
+    if (replay_from >= next_tick) {
+        return 0;
+    }
+    TRACE_ZONE("roll_back");
+    size_t replayed = 0;
+    rollBack(replay_from);
+    board.replaying = true;
+    for (uint32_t tick = replay_from; tick < next_tick; ++tick) {
+        if (tick != replay_from) {
+            save(tick);
+        }
+        run(tick, pool);
+        replayed++;
+    }
+    board.replaying = false;
+    ticks_replayed += replayed;
+    replay_from = next_tick;
+    return replayed;
+}
+
+size_t RollbackSimulation::advance(ThreadPool* pool) {
+    size_t replayed = catchUp(pool);
+    save(next_tick);
+    run(next_tick, pool);
+    next_tick++;
+    replay_from = next_tick;
+
+    // Make room for the next tick; the oldest one is final from now on
+    if (next_tick - first_tick + 1 > history.size()) {
+        SavedTick& oldest = slot(first_tick);
+        if (final_handler) {
+            final_handler(first_tick, oldest.moves);
+        }
+        oldest.moves.clear();
+        oldest.collected.clear();
+        oldest.timer_ops.clear();
+        first_tick++;
+    }
+    return replayed;
+}
+
+bool RollbackSimulation::moved(uint64_t handle) const {
+    uint32_t tick = (uint32_t)(handle >> 32);
+    size_t index = (size_t)(uint32_t)handle;
+    if (tick < first_tick || tick >= next_tick) {
+        return false;
+    }
+    const vector<Move>& moves = slot(tick).moves;
+    return index < moves.size() && moves[index].moved;
+}
+
+void RollbackSimulation::finish() {
+    for (; first_tick < next_tick; ++first_tick) {
+        SavedTick& saved = slot(first_tick);
+        if (final_handler) {
+            final_handler(first_tick, saved.moves);
+        }
+        saved.moves.clear();
+        saved.collected.clear();
+        saved.timer_ops.clear();
+    }
+    slot(next_tick).moves.clear();
+    replay_from = next_tick;
+}
+
+void RollbackSimulation::save(uint32_t tick) {
+    SavedTick& saved = slot(tick);
+    saved.players = board.players;
+}
+
+void RollbackSimulation::run(uint32_t tick, ThreadPool* pool) {
+    SavedTick& saved = slot(tick);
+    for (const auto& move : saved.moves) {
+        resolver.add(move.player_id, move.dir);
+    }
+    board.items.setJournal(&saved.collected);
+    board.timers.setJournal(&saved.timer_ops);
+    runTimers(board, tick);
+    resolver.resolve(board, pool);
+    board.timers.setJournal(nullptr);
+    board.items.setJournal(nullptr);
+    for (size_t i = 0; i < saved.moves.size(); ++i) {
+        saved.moves[i].moved = resolver.moved(i);
+    }
+}
+
+void RollbackSimulation::rollBack(uint32_t tick) {
+    board.timers.rewind(tick);
+    for (uint32_t t = next_tick; t-- > tick;) {
+        // Collections came after the tick's timers fired, so go first
+        SavedTick& saved = slot(t);
+        for (uint32_t item : saved.collected) {
+            board.items.uncollect(item);
+        }
+        saved.collected.clear();
+        undoTimers(board, saved.timer_ops);
+        saved.timer_ops.clear();
+    }
+    const SavedTick& start = slot(tick);
+    board.players = start.players;
+    // The collected bits are back as they were; count what they leave
+    board.items_remaining = (int)board.items.countRemaining();
+    board.restocks++;
+    board.version++;
+}
@@ -0,0 +1,94 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include "game_board.h"
+#include "move_resolver.h"
+#include "thread_pool.h"
+
+// Runs a board tick by tick, keeping the last few ticks of history so that
+// a move which arrives late can still be applied at the tick it was meant
+// for: the board is rolled back to the start of that tick and the ticks
+// since are replayed with the move included. The outcome is the same as
+// if every move had arrived in time.
+//
+// A saved tick is small. Players are plain data and are copied whole;
+// instead of a copy of the collected bits and the timers, each tick keeps
+// a journal of the items collected in it and of its timer ops (respawns
+// and power-ups), and rolling back undoes them.
+class RollbackSimulation {
+public:
+    // Moves can be added up to max_ticks - 1 ticks late
+    RollbackSimulation(GameBoard& board, size_t max_ticks);
+
+    // The tick the next advance() runs
+    uint32_t tick() const { return next_tick; }
+
+    // The oldest tick a move can still be added to
+    uint32_t oldestTick() const { return first_tick; }
+
+    // Queue a move for a tick up to tick(); moves for ticks that have left
+    // the history are applied at oldestTick(). Returns a handle for moved().
+    uint64_t add(uint32_t tick, int player_id, int dir);
+
+    // Replay from the earliest tick that got a late move, so the board
+    // shows every move added so far. Returns the number of ticks replayed.
+    size_t catchUp(ThreadPool* pool = nullptr);
+
+    // catchUp(), then run tick(). Returns the number of ticks replayed.
+    size_t advance(ThreadPool* pool = nullptr);
+
+    // Whether the move behind handle changed its player's position the
+    // last time its tick ran; false once the tick has left the history
+    bool moved(uint64_t handle) const;
+
+    // Called with each tick's moves, in tick order, once no late move can
+    // change them any more; finish() hands over the rest
+    struct Move {
+        int player_id;
+        int dir;
+        bool moved;
+    };
+    typedef std::function<void(uint32_t tick, const std::vector<Move>& moves)> FinalHandler;
+    void onFinal(FinalHandler handler) { final_handler = handler; }
+    void finish();
+
+    // Ticks replayed because of late moves, over the whole run
+    uint64_t replayed() const { return ticks_replayed; }
+
+private:
+    RollbackSimulation(const RollbackSimulation&);
+    RollbackSimulation& operator=(const RollbackSimulation&);
+
+    static_assert(std::is_trivially_copyable<Player>::value, "players are saved by copying");
+
+    // The board at the start of a tick, and what happened in it
+    struct SavedTick {
+        std::vector<Player> players;
+        std::vector<Move> moves;
+        std::vector<uint32_t> collected;   // Items collected during the tick
+        std::vector<TimerOp> timer_ops;    // Timers scheduled and fired during it
+    };
+
+    SavedTick& slot(uint32_t tick) { return history[tick % history.size()]; }
+    const SavedTick& slot(uint32_t tick) const { return history[tick % history.size()]; }
+
+    void save(uint32_t tick);
+    void run(uint32_t tick, ThreadPool* pool);
+    void rollBack(uint32_t tick);
+
+    GameBoard& board;
+    MoveResolver resolver;
+    std::vector<SavedTick> history;
+    uint32_t next_tick;
+    uint32_t first_tick;        // Oldest tick in history
+    uint32_t replay_from;       // Earliest tick with a late move, or next_tick
+    uint64_t ticks_replayed;
+    FinalHandler final_handler;
+};
+
+#endif // ROLLBACK_H
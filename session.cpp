@@ -0,0 +1,173 @@
+#include "session.h"
+
+#include <algorithm>
+#include <chrono>
+#include "trace.h"
+
+using namespace std;
+
+GameSession::GameSession(int id, uint32_t seed, int board_size, int num_players, int first_bot, long max_moves,
+                         const BoardRules& rules, ThreadPool* pool) :
+    session_id(id), game_board(seed, board_size, num_players, -1, pool), max_moves(max_moves), moves_applied(0),
+    tick_number(0), stuck(false), scheduler(nullptr), state(SessionScheduler::PARKED), deadline_ns(0) {
+    game_board.rules = rules;
+    vector<int> ids;
+    for (int i = max(0, first_bot); i < num_players; ++i) {
+        ids.push_back(i);
+    }
+    if (!ids.empty()) {
+        bots.reset(new BotEngine(game_board, ids));
+    }
+}
+
+bool GameSession::finished() const {
+    return game_board.items_remaining == 0 || moves_applied >= max_moves || stuck;
+}
+
+void GameSession::post(const GameMessage& msg) {
+    {
+        lock_guard<mutex> lock(inbox_mutex);
+        inbox.push_back(msg);
+    }
+    if (scheduler) {
+        scheduler->wake(*this);
+    }
+}
+
+bool GameSession::idle() {
+    lock_guard<mutex> lock(inbox_mutex);
+    return !bots && inbox.empty();
+}
+
+void GameSession::tick() {
+    runTimers(game_board, tick_number);
+    {
+        lock_guard<mutex> lock(inbox_mutex);
+        applying.swap(inbox);
+    }
+    for (size_t i = 0; i < applying.size() && moves_applied < max_moves; ++i) {
+        const GameMessage& msg = applying[i];
+        int dir = directionOf(msg.dx, msg.dy);
+        if (msg.type == GameMessage::MOVE && dir >= 0) {
+            resolver.add(msg.player_id, dir);
+            moves_applied++;
+        }
+    }
+    applying.clear();
+
+    long before = moves_applied;
+    if (bots && !finished()) {
+        bots->sync(game_board);
+        bots->plan(game_board, 0, bots->size());
+        for (size_t i = 0; i < bots->size() && moves_applied < max_moves; ++i) {
+            int dir = bots->move(i);
+            if (dir >= 0) {
+                resolver.add(bots->playerId(i), dir);
+                moves_applied++;
+            }
+        }
+        stuck = moves_applied == before;
+    }
+    resolver.resolve(game_board);
+    tick_number++;
+}
+
+SessionScheduler::SessionScheduler(ThreadPool& pool, int tick_rate) :
+    pool(pool), period_ns(1000000000ULL / (uint64_t)max(1, tick_rate)), next_order(0), live(0), ticking(0) {}
+
+void SessionScheduler::add(GameSession& session) {
+    lock_guard<std::mutex> lock(mutex);
+    session.scheduler = this;
+    if (session.finished()) {
+        session.state = DONE;
+        return;
+    }
+    live++;
+    queue(session, nowNs());
+}
+
+void SessionScheduler::queue(GameSession& session, uint64_t deadline_ns) {
+    session.state = QUEUED;
+    session.deadline_ns = deadline_ns;
+    // The dispatcher only needs waking if it is sleeping past this deadline
+    bool earliest = due.empty() || deadline_ns < due.top().deadline_ns;
+    Due entry = {deadline_ns, next_order++, &session};
+    due.push(entry);
+    if (earliest) {
+        changed.notify_one();
+    }
+}
+
+void SessionScheduler::wake(GameSession& session) {
+    lock_guard<std::mutex> lock(mutex);
+    if (session.state == PARKED) {
+        queue(session, max(session.deadline_ns, nowNs()));
+    }
+}
+
+void SessionScheduler::runTicks(const vector<GameSession*>& batch) {
+    for (GameSession* session : batch) {
+        uint64_t start = nowNs();
+        late.record(start > session->deadline_ns ? start - session->deadline_ns : 0);
+        TRACE_ZONE("session_tick");
+        session->tick();
+        metrics.tickTime.record(nowNs() - start);
+    }
+    metrics.ticks.fetch_add(batch.size(), memory_order_relaxed);
+
+    lock_guard<std::mutex> lock(mutex);
+    uint64_t now = nowNs();
+    for (GameSession* session : batch) {
+        uint64_t next = session->deadline_ns + period_ns;
+        if (now > next + period_ns) {
+            next = now;  // Fell behind; don't try to catch up
+        }
+        if (session->finished()) {
+            session->state = DONE;
+            live--;
+        } else if (session->idle()) {
+            session->state = PARKED;
+            session->deadline_ns = next;
+        } else {
+            queue(*session, next);
+        }
+    }
+    ticking -= batch.size();
+    if (live == 0 || ticking == 0) {
+        changed.notify_one();
+    }
+}
+
+void SessionScheduler::run(const atomic<bool>& running) {
+    typedef chrono::steady_clock Clock;
+    const chrono::milliseconds poll_running(100);
+
+    unique_lock<std::mutex> lock(mutex);
+    while (running && live > 0) {
+        if (due.empty()) {
+            changed.wait_for(lock, poll_running);
+            continue;
+        }
+        uint64_t now = nowNs();
+        if (due.top().deadline_ns > now) {
+            uint64_t wait_ns = min<uint64_t>(due.top().deadline_ns - now, 100000000ULL);
+            changed.wait_until(lock, Clock::now() + chrono::nanoseconds(wait_ns));
+            continue;
+        }
+        // Hand out the due sessions a batch per task
+        while (!due.empty() && due.top().deadline_ns <= now) {
+            shared_ptr<vector<GameSession*> > batch(new vector<GameSession*>());
+            while (!due.empty() && due.top().deadline_ns <= now && batch->size() < SESSIONS_PER_TASK) {
+                GameSession* session = due.top().session;
+                due.pop();
+                session->state = TICKING;
+                batch->push_back(session);
+            }
+            ticking += batch->size();
+            pool.submit([this, batch]() { runTicks(*batch); });
+        }
+    }
+    while (ticking > 0) {
+        changed.wait(lock);
+    }
+}
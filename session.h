@@ -0,0 +1,128 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include "bot_engine.h"
+#include "game_board.h"
+#include "metrics.h"
+#include "move_resolver.h"
+#include "thread_pool.h"
+
+class SessionScheduler;
+
+// One match: its own board, an inbox for moves from outside and
+// controllers for its bot players. Nothing in it touches the global game,
+// so any number of sessions can run side by side in one process.
+class GameSession {
+public:
+    // Players from first_bot on are bots. The session ends when every item
+    // is collected, the bots are stuck, or max_moves moves were applied.
+    // A big board is built on pool, when given.
+    GameSession(int id, uint32_t seed, int board_size, int num_players, int first_bot, long max_moves,
+                const BoardRules& rules = BoardRules(), ThreadPool* pool = nullptr);
+
+    int id() const { return session_id; }
+    const GameBoard& board() const { return game_board; }
+    uint32_t ticks() const { return tick_number; }
+    long moves() const { return moves_applied; }
+
+    // Only meaningful while the session isn't being ticked, e.g. once the
+    // scheduler is done with it
+    bool finished() const;
+
+    // Queue a move for the next tick. Safe to call from any thread; wakes
+    // the session if it was parked for lack of anything to do.
+    void post(const GameMessage& msg);
+
+private:
+    friend class SessionScheduler;
+
+    GameSession(const GameSession&);
+    GameSession& operator=(const GameSession&);
+
+    // Resolve the posted moves and the bots' moves as one batch, so a
+    // session plays the same whatever thread ticks it
+    void tick();
+
+    // Nothing will change until a move is posted
+    bool idle();
+
+    int session_id;
+    GameBoard game_board;
+    std::unique_ptr<BotEngine> bots;
+    MoveResolver resolver;
+    long max_moves;
+    long moves_applied;
+    uint32_t tick_number;
+    bool stuck;                        // No bot could move last tick
+
+    std::mutex inbox_mutex;
+    std::vector<GameMessage> inbox;
+    std::vector<GameMessage> applying; // Swapped with inbox each tick
+
+    // Owned by the scheduler, under its mutex
+    SessionScheduler* scheduler;
+    int state;
+    uint64_t deadline_ns;
+};
+
+// Ticks many sessions on a shared worker pool. Each session has its own
+// tick deadline; a dispatcher thread sleeps until the earliest one is due
+// and hands the due sessions to the pool in batches. A session is
+// never ticked by two workers at once, and one with nothing to do is
+// parked until a move is posted to it, so idle sessions cost no CPU.
+class SessionScheduler {
+public:
+    SessionScheduler(ThreadPool& pool, int tick_rate);
+
+    // Start ticking a session; it must outlive run()
+    void add(GameSession& session);
+
+    // Dispatch ticks on the calling thread until every session has
+    // finished or running goes false. Returns once no tick is in flight.
+    void run(const std::atomic<bool>& running);
+
+    // How late ticks started relative to their deadlines
+    const LatencyHistogram& lateness() const { return late; }
+
+private:
+    friend class GameSession;
+
+    enum State { QUEUED, TICKING, PARKED, DONE };
+
+    // Due sessions ticked by one pool task
+    static const size_t SESSIONS_PER_TASK = 16;
+
+    struct Due {
+        uint64_t deadline_ns;
+        uint64_t order;                // Keeps equal deadlines first come, first served
+        GameSession* session;
+
+        bool operator>(const Due& other) const {
+            return deadline_ns != other.deadline_ns ? deadline_ns > other.deadline_ns : order > other.order;
+        }
+    };
+
+    void queue(GameSession& session, uint64_t deadline_ns);
+    void wake(GameSession& session);
+    void runTicks(const std::vector<GameSession*>& batch);
+
+    ThreadPool& pool;
+    uint64_t period_ns;
+    LatencyHistogram late;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due> > due;
+    uint64_t next_order;
+    size_t live;                       // Sessions that haven't finished
+    size_t ticking;                    // Ticks handed to the pool and not done yet
+};
+
+#endif // SESSION_H
@@ -0,0 +1,213 @@
+#include "shm_input.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const uint32_t SHM_MAGIC = 0x474d5348;   // "HSMG"
+const uint32_t SHM_VERSION = 1;
+
+#ifdef __linux__
+// The words live in memory shared between processes, so no
+// FUTEX_PRIVATE_FLAG
+void futexWait(atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    timespec timeout = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futexWake(atomic<uint32_t>* word) {
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
+
+} // namespace
+
+ShmInputRing::ShmInputRing() : segment(nullptr), fd(-1), lane(nullptr), full_waits(0),
+    discarded_moves(0) {}
+
+ShmInputRing::~ShmInputRing() {
+#ifdef __linux__
+    if (lane) {
+        lane->producer_waiting.store(0, memory_order_relaxed);
+        lane->owner.store(0, memory_order_release);
+    }
+    if (segment) {
+        munmap(segment, sizeof(Segment));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+bool ShmInputRing::map(int new_fd) {
+#ifdef __linux__
+    void* mem = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, new_fd, 0);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    segment = (Segment*)mem;
+    fd = new_fd;
+    return true;
+#else
+    (void)new_fd;
+    return false;
+#endif
+}
+
+bool ShmInputRing::create(int num_players) {
+#ifdef __linux__
+    int new_fd = (int)syscall(SYS_memfd_create, "game-input", 0);
+    if (new_fd < 0) {
+        return false;
+    }
+    // A fresh memfd reads as zeros: every lane free and empty
+    if (ftruncate(new_fd, sizeof(Segment)) != 0 || !map(new_fd)) {
+        close(new_fd);
+        return false;
+    }
+    segment->players = (uint32_t)num_players;
+    segment->version = SHM_VERSION;
+    segment->magic = SHM_MAGIC;
+    shared_path = "/proc/" + to_string(getpid()) + "/fd/" + to_string(fd);
+    return true;
+#else
+    (void)num_players;
+    return false;
+#endif
+}
+
+bool ShmInputRing::attach(const string& at) {
+#ifdef __linux__
+    int new_fd = open(at.c_str(), O_RDWR | O_CLOEXEC);
+    if (new_fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(new_fd, &info) != 0 || (size_t)info.st_size != sizeof(Segment) || !map(new_fd)) {
+        close(new_fd);
+        return false;
+    }
+    if (segment->magic != SHM_MAGIC || segment->version != SHM_VERSION) {
+        return false;
+    }
+    shared_path = at;
+
+    // Take a free lane, or one whose producer has exited without letting go
+    uint32_t self = (uint32_t)getpid();
+    for (uint32_t l = 0; l < SHM_LANES; ++l) {
+        Lane& candidate = segment->lanes[l];
+        uint32_t owner = candidate.owner.load(memory_order_acquire);
+        if (owner != 0 && (kill((pid_t)owner, 0) == 0 || errno != ESRCH)) {
+            continue;
+        }
+        if (candidate.owner.compare_exchange_strong(owner, self, memory_order_acq_rel)) {
+            candidate.producer_waiting.store(0, memory_order_relaxed);
+            lane = &candidate;
+            return true;
+        }
+    }
+    return false;
+#else
+    (void)at;
+    return false;
+#endif
+}
+
+int ShmInputRing::players() const {
+    return segment ? (int)segment->players : 0;
+}
+
+size_t ShmInputRing::push(const ShmMove* moves, size_t count, int timeout_ms) {
+#ifdef __linux__
+    size_t done = 0;
+    while (done < count) {
+        uint32_t tail = lane->tail.load(memory_order_relaxed);
+        uint32_t head = lane->head.load(memory_order_acquire);
+        uint32_t room = SHM_LANE_SIZE - (tail - head);
+        if (room == 0 || room > SHM_LANE_SIZE) {
+            // Full. Say so before looking at head once more, so the
+            // consumer either sees the flag or we see its new head.
+            full_waits++;
+            lane->producer_waiting.store(1, memory_order_seq_cst);
+            if (lane->head.load(memory_order_seq_cst) == head) {
+                futexWait(&lane->head, head, timeout_ms);
+            }
+            lane->producer_waiting.store(0, memory_order_relaxed);
+            if (lane->head.load(memory_order_acquire) == head) {
+                break;   // Timed out
+            }
+            continue;
+        }
+        uint32_t n = (uint32_t)min((size_t)room, count - done);
+        for (uint32_t i = 0; i < n; ++i) {
+            lane->moves[(tail + i) & (SHM_LANE_SIZE - 1)] = moves[done + i];
+        }
+        lane->tail.store(tail + n, memory_order_release);
+        done += n;
+
+        // The other half of wait(): the consumer sets its flag and then
+        // looks at the tails, we publish the tail and then look at the flag
+        atomic_thread_fence(memory_order_seq_cst);
+        if (segment->consumer_waiting.load(memory_order_relaxed)) {
+            segment->consumer_waiting.store(0, memory_order_relaxed);
+            segment->wakeups.fetch_add(1, memory_order_release);
+            futexWake(&segment->wakeups);
+        }
+    }
+    return done;
+#else
+    (void)moves;
+    (void)count;
+    (void)timeout_ms;
+    return 0;
+#endif
+}
+
+bool ShmInputRing::hasPending() const {
+    for (uint32_t l = 0; l < SHM_LANES; ++l) {
+        const Lane& from = segment->lanes[l];
+        if (from.tail.load(memory_order_seq_cst) != from.head.load(memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShmInputRing::wait(int timeout_ms) {
+#ifdef __linux__
+    uint32_t seen = segment->wakeups.load(memory_order_acquire);
+    segment->consumer_waiting.store(1, memory_order_seq_cst);
+    if (!hasPending()) {
+        futexWait(&segment->wakeups, seen, timeout_ms);
+    }
+    segment->consumer_waiting.store(0, memory_order_relaxed);
+#else
+    (void)timeout_ms;
+#endif
+}
+
+void ShmInputRing::wakeProducer(Lane& from) {
+#ifdef __linux__
+    atomic_thread_fence(memory_order_seq_cst);
+    if (from.producer_waiting.load(memory_order_relaxed)) {
+        futexWake(&from.head);
+    }
+#else
+    (void)from;
+#endif
+}
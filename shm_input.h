@@ -0,0 +1,137 @@
+#ifndef SHM_INPUT_H
+#define SHM_INPUT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "message_queue.h"
+
+// Moves from other processes, e.g. the loadgen tool.
+//
+// The game creates a memfd holding SHM_LANES single-producer rings. A
+// producer process maps it through path() (/proc/<pid>/fd/<fd>), claims a
+// lane of its own and pushes moves into it with no syscall at all. As in
+// FanInQueue, producers never share a lane, so no locks are needed, and a
+// producer that crashes can only hurt its own lane: nothing it half wrote
+// is ever published, and the lane goes to the next producer to attach.
+// The consumer trusts nothing it reads from the shared memory; bad
+// indexes or moves are discarded.
+//
+// Sleeping uses futexes on words in the shared memory. The consumer
+// sleeps in wait() until a producer publishes, and a producer whose lane
+// is full sleeps until the consumer makes room. Either side only makes
+// the wake syscall when the other one is actually asleep.
+//
+// Linux only; elsewhere create() and attach() fail.
+const uint32_t SHM_LANES = 64;
+const uint32_t SHM_LANE_SIZE = 1 << 14;   // Moves per lane, 256 KB
+
+struct ShmMove {
+    int32_t player_id;
+    int32_t dir;
+    uint64_t created_ns;   // nowNs() in the producer; the clock is system wide
+};
+
+class ShmInputRing {
+public:
+    ShmInputRing();
+    ~ShmInputRing();
+
+    // Consumer: create the shared memory for a game with num_players
+    // players. Producers attach to path().
+    bool create(int num_players);
+    std::string path() const { return shared_path; }
+
+    // Producer: map the memory at path and claim a lane that is free or
+    // whose producer has exited
+    bool attach(const std::string& path);
+
+    // Producer: the game's player count
+    int players() const;
+
+    // Producer: queue count moves, waiting up to timeout_ms at a time for
+    // the consumer to make room while the lane is full. Returns how many
+    // were queued.
+    size_t push(const ShmMove* moves, size_t count, int timeout_ms);
+
+    // Producer: times push() had to wait for room
+    uint64_t fullWaits() const { return full_waits; }
+
+    // Consumer: apply(move) for every queued move, lane by lane; returns
+    // how many there were
+    template <typename Apply>
+    size_t drain(Apply apply);
+
+    // Consumer: sleep for up to timeout_ms unless moves are waiting
+    void wait(int timeout_ms);
+
+    // Consumer: moves thrown away because a lane's indexes were garbage
+    uint64_t discarded() const { return discarded_moves; }
+
+private:
+    ShmInputRing(const ShmInputRing&);
+    ShmInputRing& operator=(const ShmInputRing&);
+
+    struct Lane {
+        // Written by the producer
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> owner;  // Producer pid, 0 if free
+        std::atomic<uint32_t> tail;
+        std::atomic<uint32_t> producer_waiting;
+        // Written by the consumer; also the producer's futex word
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> head;
+        alignas(CACHE_LINE_SIZE) ShmMove moves[SHM_LANE_SIZE];
+    };
+
+    struct Segment {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t players;
+        // The consumer's futex word, bumped by a producer that wakes it
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> wakeups;
+        std::atomic<uint32_t> consumer_waiting;
+        Lane lanes[SHM_LANES];
+    };
+
+    bool map(int fd);
+    bool hasPending() const;
+    void wakeProducer(Lane& lane);
+
+    Segment* segment;
+    int fd;
+    std::string shared_path;
+    Lane* lane;                 // Producer: the claimed lane
+    uint64_t full_waits;
+    uint64_t discarded_moves;
+};
+
+template <typename Apply>
+size_t ShmInputRing::drain(Apply apply) {
+    size_t total = 0;
+    for (uint32_t l = 0; l < SHM_LANES; ++l) {
+        Lane& from = segment->lanes[l];
+        uint32_t head = from.head.load(std::memory_order_relaxed);
+        uint32_t count = from.tail.load(std::memory_order_acquire) - head;
+        if (count == 0) {
+            continue;
+        }
+        if (count > SHM_LANE_SIZE) {
+            // The producer wrote nonsense into its tail; drop the lane's
+            // contents rather than read past them
+            discarded_moves += count;
+            from.head.store(head + count, std::memory_order_release);
+            wakeProducer(from);
+            continue;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            ShmMove move = from.moves[(head + i) & (SHM_LANE_SIZE - 1)];
+            apply(move);
+        }
+        from.head.store(head + count, std::memory_order_release);
+        wakeProducer(from);
+        total += count;
+    }
+    return total;
+}
+
+#endif // SHM_INPUT_H
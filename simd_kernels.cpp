@@ -0,0 +1,136 @@
+#include "simd_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void matchCellsScalar(const uint32_t* xs, const uint32_t* ys, size_t count,
+                      const uint32_t* cell_x, const uint32_t* cell_y, size_t num_cells,
+                      uint64_t* hits) {
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t c = 0; c < num_cells; ++c) {
+            if (xs[i] == cell_x[c] && ys[i] == cell_y[c]) {
+                hits[i / 64] |= 1ULL << (i % 64);
+                break;
+            }
+        }
+    }
+}
+
+size_t popcountScalar(const uint64_t* words, size_t num_words) {
+    size_t total = 0;
+    for (size_t i = 0; i < num_words; ++i) {
+        total += (size_t)__builtin_popcountll(words[i]);
+    }
+    return total;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// 4 items per step; lanes are 32-bit coordinates
+void matchCellsSse2(const uint32_t* xs, const uint32_t* ys, size_t count,
+                    const uint32_t* cell_x, const uint32_t* cell_y, size_t num_cells,
+                    uint64_t* hits) {
+    for (size_t i = 0; i < count; i += 4) {
+        __m128i vx = _mm_loadu_si128((const __m128i*)(xs + i));
+        __m128i vy = _mm_loadu_si128((const __m128i*)(ys + i));
+        __m128i match = _mm_setzero_si128();
+        for (size_t c = 0; c < num_cells; ++c) {
+            __m128i eq = _mm_and_si128(_mm_cmpeq_epi32(vx, _mm_set1_epi32((int)cell_x[c])),
+                                       _mm_cmpeq_epi32(vy, _mm_set1_epi32((int)cell_y[c])));
+            match = _mm_or_si128(match, eq);
+        }
+        uint64_t mask = (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(match));
+        if (i + 4 > count) {
+            mask &= (1ULL << (count - i)) - 1;  // Padding past the last item
+        }
+        hits[i / 64] |= mask << (i % 64);
+    }
+}
+
+// 8 items per step
+__attribute__((target("avx2")))
+void matchCellsAvx2(const uint32_t* xs, const uint32_t* ys, size_t count,
+                    const uint32_t* cell_x, const uint32_t* cell_y, size_t num_cells,
+                    uint64_t* hits) {
+    for (size_t i = 0; i < count; i += 8) {
+        __m256i vx = _mm256_loadu_si256((const __m256i*)(xs + i));
+        __m256i vy = _mm256_loadu_si256((const __m256i*)(ys + i));
+        __m256i match = _mm256_setzero_si256();
+        for (size_t c = 0; c < num_cells; ++c) {
+            __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi32(vx, _mm256_set1_epi32((int)cell_x[c])),
+                                          _mm256_cmpeq_epi32(vy, _mm256_set1_epi32((int)cell_y[c])));
+            match = _mm256_or_si256(match, eq);
+        }
+        if (_mm256_testz_si256(match, match)) {
+            continue;
+        }
+        uint64_t mask = (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(match));
+        if (i + 8 > count) {
+            mask &= (1ULL << (count - i)) - 1;
+        }
+        hits[i / 64] |= mask << (i % 64);
+    }
+}
+
+__attribute__((target("popcnt")))
+size_t popcountHardware(const uint64_t* words, size_t num_words) {
+    size_t total = 0;
+    for (size_t i = 0; i < num_words; ++i) {
+        total += (size_t)__builtin_popcountll(words[i]);
+    }
+    return total;
+}
+
+#endif // HAVE_X86_KERNELS
+
+typedef void (*MatchCellsFn)(const uint32_t*, const uint32_t*, size_t,
+                             const uint32_t*, const uint32_t*, size_t, uint64_t*);
+typedef size_t (*PopcountFn)(const uint64_t*, size_t);
+
+struct Kernels {
+    MatchCellsFn matchCells;
+    PopcountFn popcount;
+    const char* name;
+
+    Kernels() : matchCells(matchCellsScalar), popcount(popcountScalar), name("scalar") {
+#ifdef HAVE_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+            matchCells = matchCellsSse2;
+            name = "sse2";
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            matchCells = matchCellsAvx2;
+            name = "avx2";
+        }
+        if (__builtin_cpu_supports("popcnt")) {
+            popcount = popcountHardware;
+        }
+#endif
+    }
+};
+
+const Kernels& kernels() {
+    static const Kernels selected;
+    return selected;
+}
+
+}
+
+void matchCells(const uint32_t* xs, const uint32_t* ys, size_t count,
+                const uint32_t* cell_x, const uint32_t* cell_y, size_t num_cells,
+                uint64_t* hits) {
+    kernels().matchCells(xs, ys, count, cell_x, cell_y, num_cells, hits);
+}
+
+size_t popcountWords(const uint64_t* words, size_t num_words) {
+    return kernels().popcount(words, num_words);
+}
+
+const char* simdKernelName() {
+    return kernels().name;
+}
@@ -0,0 +1,28 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized scans over structure-of-arrays entity data. On x86 each
+// kernel has an AVX2, an SSE2 and a scalar version and the best one the
+// CPU supports is picked on first use; elsewhere the scalar version runs.
+
+// Items are processed in blocks of this many; coordinate arrays passed to
+// matchCells must be readable (padded) up to a multiple of it
+const size_t SIMD_BLOCK = 8;
+
+// Set bit i of hits for every item i in [0, count) that stands on one of
+// the num_cells query cells (cell_x[c], cell_y[c]). Bits of other items are
+// left alone.
+void matchCells(const uint32_t* xs, const uint32_t* ys, size_t count,
+                const uint32_t* cell_x, const uint32_t* cell_y, size_t num_cells,
+                uint64_t* hits);
+
+// Total number of set bits in words[0, num_words)
+size_t popcountWords(const uint64_t* words, size_t num_words);
+
+// "avx2", "sse2" or "scalar"
+const char* simdKernelName();
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,75 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include "metrics.h"
+
+using namespace std;
+
+void SnapshotBuffer::follow(int player_id) {
+    lock_guard<mutex> lock(mtx);
+    followed = player_id;
+}
+
+void SnapshotBuffer::publish(const GameBoard& board, vector<InputStamp>& inputs) {
+    lock_guard<mutex> lock(mtx);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (latest.inputs.size() < MAX_TRACKED_INPUTS) {
+            latest.inputs.push_back(inputs[i]);
+        } else {
+            metrics.unsampled++;
+        }
+    }
+    inputs.clear();
+    if (board.version == latest.version && latest.board_size != 0) {
+        return;
+    }
+    latest.version = board.version;
+    latest.board_size = board.board_size;
+    latest.players = board.players;
+
+    int size = min(board.board_size, MAX_VIEW_CELLS);
+    int x = 0;
+    int y = 0;
+    if (size < board.board_size && followed >= 0 && followed < (int)board.players.size()) {
+        const Player& player = board.players[followed];
+        x = max(0, min(player.x - size / 2, board.board_size - size));
+        y = max(0, min(player.y - size / 2, board.board_size - size));
+    }
+    bool moved = x != latest.view_x || y != latest.view_y || size != latest.view_size;
+    if (moved || latest.items_remaining != board.items_remaining || restocks != board.restocks) {
+        restocks = board.restocks;
+        latest.view_x = x;
+        latest.view_y = y;
+        latest.view_size = size;
+        latest.items.clear();
+        const ItemStore& items = board.items;
+        board.forEachItemIn(x, y, size, [this, &items](size_t i) {
+            latest.items.push_back(make_pair((int)items.x(i), (int)items.y(i)));
+        });
+        latest.items_remaining = board.items_remaining;
+        latest.items_version++;
+    }
+    fresh = true;
+}
+
+bool SnapshotBuffer::acquire(GameSnapshot& out) {
+    lock_guard<mutex> lock(mtx);
+    out.inputs.insert(out.inputs.end(), latest.inputs.begin(), latest.inputs.end());
+    latest.inputs.clear();
+    if (!fresh) {
+        return false;
+    }
+    out.version = latest.version;
+    out.board_size = latest.board_size;
+    out.players = latest.players;
+    out.view_x = latest.view_x;
+    out.view_y = latest.view_y;
+    out.view_size = latest.view_size;
+    out.items_remaining = latest.items_remaining;
+    if (out.items_version != latest.items_version) {
+        out.items = latest.items;
+        out.items_version = latest.items_version;
+    }
+    fresh = false;
+    return true;
+}
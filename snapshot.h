@@ -0,0 +1,66 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "game_board.h"
+
+// Timestamps of an input that changed the board, kept until it is on screen
+struct InputStamp {
+    uint64_t created_ns;
+    uint64_t applied_ns;
+};
+
+// Everything the renderer needs from one simulation tick
+struct GameSnapshot {
+    unsigned long version;
+    int board_size;
+    int view_x;                               // Square of the board the camera shows;
+    int view_y;                               // the whole board unless it is bigger
+    int view_size;                            // than MAX_VIEW_CELLS
+    std::vector<Player> players;
+    std::vector<std::pair<int, int> > items;  // Cells of uncollected items in the view
+    int items_remaining;
+    unsigned long items_version;              // Changes whenever items does
+    std::vector<InputStamp> inputs;           // Inputs applied since the last present
+
+    GameSnapshot() : version(0), board_size(0), view_x(0), view_y(0), view_size(0),
+                     items_remaining(-1), items_version(0) {}
+};
+
+// Hands the latest board state from the simulation thread to the render
+// thread. The simulation publishes after every tick that changed something;
+// the renderer copies out the newest state whenever it draws a frame, so
+// each frame shows one consistent tick.
+class SnapshotBuffer {
+public:
+    // Widest view the camera shows; on bigger boards it follows a player
+    // and only the items inside it are copied
+    static const int MAX_VIEW_CELLS = 128;
+
+    SnapshotBuffer() : followed(0), fresh(false), restocks(0) {}
+
+    // Player the camera stays centered on
+    void follow(int player_id);
+
+    // Simulation thread. Takes (and clears) the stamps of inputs applied
+    // since the last publish.
+    void publish(const GameBoard& board, std::vector<InputStamp>& inputs);
+
+    // Render thread. Returns false if nothing was published since last time.
+    // Input stamps are appended to out.inputs; the caller clears them once
+    // they have been presented.
+    bool acquire(GameSnapshot& out);
+
+private:
+    static const size_t MAX_TRACKED_INPUTS = 4096;
+
+    std::mutex mtx;
+    GameSnapshot latest;
+    int followed;
+    bool fresh;
+    unsigned long restocks;    // The board's, when latest.items was filled
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,191 @@
+#include "soft_render.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "render.h"
+#include "trace.h"
+
+using namespace std;
+
+SoftwareRenderer::SoftwareRenderer() :
+    frame((size_t)SCREEN_SIZE * SCREEN_SIZE * 3), tiles((SCREEN_SIZE + TILE_SIZE - 1) / TILE_SIZE),
+    binned((size_t)tiles * tiles) {
+    pen[0] = pen[1] = pen[2] = 0;
+}
+
+int SoftwareRenderer::size() const {
+    return SCREEN_SIZE;
+}
+
+void SoftwareRenderer::fill(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, uint8_t alpha) {
+    Rect rect = {max(x, 0), max(y, 0), min(x + w, SCREEN_SIZE), min(y + h, SCREEN_SIZE), r, g, b, alpha};
+    if (rect.x0 < rect.x1 && rect.y0 < rect.y1) {
+        rects.push_back(rect);
+    }
+}
+
+// Every line the game draws is horizontal or vertical
+void SoftwareRenderer::line(int x1, int y1, int x2, int y2) {
+    fill(min(x1, x2), min(y1, y2), abs(x2 - x1) + 1, abs(y2 - y1) + 1, pen[0], pen[1], pen[2]);
+}
+
+// Like SDL_RenderDrawRect
+void SoftwareRenderer::outline(int x, int y, int w, int h) {
+    line(x, y, x + w - 1, y);
+    line(x, y + h - 1, x + w - 1, y + h - 1);
+    line(x, y, x, y + h - 1);
+    line(x + w - 1, y, x + w - 1, y + h - 1);
+}
+
+// Like drawNumber
+void SoftwareRenderer::number(unsigned long value, int x, int y, int digitWidth, int digitHeight) {
+    DigitStroke strokes[MAX_DIGIT_STROKES];
+    for (char c : to_string(value)) {
+        int count = digitStrokes(c - '0', x, y, digitWidth, digitHeight, strokes);
+        for (int i = 0; i < count; ++i) {
+            line(strokes[i].x1, strokes[i].y1, strokes[i].x2, strokes[i].y2);
+        }
+        x += digitWidth + digitWidth / 4;
+    }
+}
+
+// Like renderScore
+void SoftwareRenderer::score(int x, int y, int score, int player) {
+    const Color& color = playerColor(player);
+    fill(x, y, 100, 50, color.r, color.g, color.b);
+    pen[0] = pen[1] = pen[2] = 255;
+    outline(x + 5, y + 10, 30, 30);
+    number(score, x + 45, y + 10, 20, 30);
+}
+
+// The frame as a list of rectangles, in the order renderGame draws them
+void SoftwareRenderer::build(const GameSnapshot& snapshot, bool gameOver) {
+    rects.clear();
+    int viewSize = snapshot.view_size;
+    int viewX = snapshot.view_x;
+    int viewY = snapshot.view_y;
+    int cellSize = SCREEN_SIZE / viewSize;
+    int cellInside = cellSize - 2 * CELL_PADDING;
+
+    fill(0, 0, SCREEN_SIZE, SCREEN_SIZE, BG_COLOR.r, BG_COLOR.g, BG_COLOR.b);
+    pen[0] = GRID_COLOR.r;
+    pen[1] = GRID_COLOR.g;
+    pen[2] = GRID_COLOR.b;
+    for (int i = 0; i <= viewSize; i++) {
+        line(i * cellSize, 0, i * cellSize, SCREEN_SIZE);
+        line(0, i * cellSize, SCREEN_SIZE, i * cellSize);
+    }
+
+    for (const auto& item : snapshot.items) {
+        fill((item.first - viewX) * cellSize + CELL_PADDING, (item.second - viewY) * cellSize + CELL_PADDING,
+             cellInside, cellInside, ITEM_COLOR.r, ITEM_COLOR.g, ITEM_COLOR.b);
+    }
+
+    // One color at a time, as renderGame batches them
+    const vector<Player>& players = snapshot.players;
+    for (int c = 0; c < NUM_PLAYER_COLORS; ++c) {
+        const Color& color = PLAYER_COLORS[c];
+        for (size_t i = c; i < players.size(); i += NUM_PLAYER_COLORS) {
+            int x = players[i].x - viewX;
+            int y = players[i].y - viewY;
+            if (x >= 0 && x < viewSize && y >= 0 && y < viewSize) {
+                fill(x * cellSize + CELL_PADDING, y * cellSize + CELL_PADDING, cellInside, cellInside,
+                     color.r, color.g, color.b);
+            }
+        }
+    }
+
+    vector<pair<int, int> > scores = hudScores(players);
+    int step = scores.size() > 1 ? (SCREEN_SIZE - 120) / (int)(scores.size() - 1) : 0;
+    for (size_t i = 0; i < scores.size(); ++i) {
+        score(10 + (int)i * step, 10, scores[i].second, scores[i].first);
+    }
+
+    if (gameOver) {
+        vector<int> finalists = leadingPlayers(players, 2);
+        const Color& winnerColor = playerColor(finalists[0]);
+        sort(finalists.begin(), finalists.end());
+
+        fill(0, 0, SCREEN_SIZE, SCREEN_SIZE, 0, 0, 0, 200);
+        fill(SCREEN_SIZE / 4, SCREEN_SIZE / 3, SCREEN_SIZE / 2, SCREEN_SIZE / 3,
+             winnerColor.r, winnerColor.g, winnerColor.b);
+        pen[0] = pen[1] = pen[2] = 255;
+        outline(SCREEN_SIZE / 4, SCREEN_SIZE / 3, SCREEN_SIZE / 2, SCREEN_SIZE / 3);
+        for (size_t i = 0; i < finalists.size(); ++i) {
+            score(SCREEN_SIZE / 4 + 50, SCREEN_SIZE / 3 + 30 + 60 * (int)i,
+                  players[finalists[i]].score, finalists[i]);
+        }
+        fill(SCREEN_SIZE / 4 + 50, SCREEN_SIZE / 3 + 150, SCREEN_SIZE / 2 - 100, 40, 255, 255, 255);
+    }
+}
+
+void SoftwareRenderer::drawTile(int tile) {
+    int tx0 = (tile % tiles) * TILE_SIZE;
+    int ty0 = (tile / tiles) * TILE_SIZE;
+    int tx1 = min(tx0 + TILE_SIZE, SCREEN_SIZE);
+    int ty1 = min(ty0 + TILE_SIZE, SCREEN_SIZE);
+    for (uint32_t index : binned[tile]) {
+        const Rect& rect = rects[index];
+        int x0 = max(rect.x0, tx0);
+        int x1 = min(rect.x1, tx1);
+        int y0 = max(rect.y0, ty0);
+        int y1 = min(rect.y1, ty1);
+        size_t row_bytes = (size_t)(x1 - x0) * 3;
+        uint8_t* first = &frame[((size_t)y0 * SCREEN_SIZE + x0) * 3];
+        if (rect.alpha == 255) {
+            // Fill the first row, then copy it down
+            for (uint8_t* p = first; p != first + row_bytes; p += 3) {
+                p[0] = rect.r;
+                p[1] = rect.g;
+                p[2] = rect.b;
+            }
+            for (int y = y0 + 1; y < y1; ++y) {
+                memcpy(first + (size_t)(y - y0) * SCREEN_SIZE * 3, first, row_bytes);
+            }
+            continue;
+        }
+        int a = rect.alpha;
+        for (int y = y0; y < y1; ++y) {
+            uint8_t* p = first + (size_t)(y - y0) * SCREEN_SIZE * 3;
+            for (uint8_t* end = p + row_bytes; p != end; p += 3) {
+                p[0] = (uint8_t)((p[0] * (255 - a) + rect.r * a) / 255);
+                p[1] = (uint8_t)((p[1] * (255 - a) + rect.g * a) / 255);
+                p[2] = (uint8_t)((p[2] * (255 - a) + rect.b * a) / 255);
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::draw(const GameSnapshot& snapshot, bool gameOver, ThreadPool* pool) {
+    TRACE_ZONE("soft_render");
+    build(snapshot, gameOver);
+
+    for (auto& bin : binned) {
+        bin.clear();
+    }
+    for (size_t i = 0; i < rects.size(); ++i) {
+        const Rect& rect = rects[i];
+        for (int ty = rect.y0 / TILE_SIZE; ty <= (rect.y1 - 1) / TILE_SIZE; ++ty) {
+            for (int tx = rect.x0 / TILE_SIZE; tx <= (rect.x1 - 1) / TILE_SIZE; ++tx) {
+                binned[ty * tiles + tx].push_back((uint32_t)i);
+            }
+        }
+    }
+
+    int count = tiles * tiles;
+    if (!pool) {
+        for (int tile = 0; tile < count; ++tile) {
+            drawTile(tile);
+        }
+        return;
+    }
+    pool->parallelFor((count + TILES_PER_TASK - 1) / TILES_PER_TASK, [this, count](size_t task) {
+        TRACE_ZONE("raster_tiles");
+        int first = (int)task * TILES_PER_TASK;
+        for (int tile = first; tile < min(first + TILES_PER_TASK, count); ++tile) {
+            drawTile(tile);
+        }
+    });
+}
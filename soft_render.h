@@ -0,0 +1,56 @@
+#ifndef SOFT_RENDER_H
+#define SOFT_RENDER_H
+
+#include <cstdint>
+#include <vector>
+#include "snapshot.h"
+#include "thread_pool.h"
+
+// Draws the same picture as renderGame into an RGB framebuffer on the
+// CPU, for exporting frames (--export) without a display or GPU.
+//
+// Everything the game draws is an axis-aligned rectangle: cells, grid
+// lines, the HUD's digit strokes. A frame is first turned into a list of
+// rectangles, each rectangle is filed under the 64 x 64 tiles it touches,
+// and then the tiles are filled in parallel on the pool. Tiles don't
+// overlap, so the workers never write the same pixels.
+class SoftwareRenderer {
+public:
+    SoftwareRenderer();
+
+    // Width and height of a frame in pixels
+    int size() const;
+
+    // Draw the board as of snapshot, with the game over screen on top
+    // once gameOver is set. The calling thread fills tiles alongside the
+    // pool's workers, or all of them without a pool.
+    void draw(const GameSnapshot& snapshot, bool gameOver, ThreadPool* pool = nullptr);
+
+    // The last frame drawn: size() rows of size() RGB pixels
+    const std::vector<uint8_t>& pixels() const { return frame; }
+
+private:
+    static const int TILE_SIZE = 64;
+    static const int TILES_PER_TASK = 8;
+
+    struct Rect {
+        int x0, y0, x1, y1;      // Pixels [x0, x1) x [y0, y1)
+        uint8_t r, g, b, alpha;  // alpha < 255 blends over what is there
+    };
+
+    void fill(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, uint8_t alpha = 255);
+    void line(int x1, int y1, int x2, int y2);
+    void outline(int x, int y, int w, int h);
+    void number(unsigned long value, int x, int y, int digitWidth, int digitHeight);
+    void score(int x, int y, int score, int player);
+    void build(const GameSnapshot& snapshot, bool gameOver);
+    void drawTile(int tile);
+
+    std::vector<uint8_t> frame;
+    std::vector<Rect> rects;
+    int tiles;                                   // Tiles across (and down)
+    std::vector<std::vector<uint32_t> > binned;  // Indexes into rects, per tile
+    uint8_t pen[3];                              // Color for line() and outline()
+};
+
+#endif // SOFT_RENDER_H
@@ -0,0 +1,330 @@
+#include "term_render.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// SGR sequences by Cell::color. Each one resets first, so switching
+// never depends on what was set before.
+enum {
+    COLOR_DEFAULT,
+    COLOR_FLOOR,
+    COLOR_ITEM,
+    COLOR_STATUS,
+    COLOR_BANNER,
+    COLOR_PLAYER  // First of NUM_TERM_PLAYER_COLORS
+};
+const char* const PALETTE[] = {
+    "\x1b[0m",
+    "\x1b[0;2m",
+    "\x1b[0;1;33m",
+    "\x1b[0;1m",
+    "\x1b[0;1;7m",
+    "\x1b[0;1;31m",  // Red
+    "\x1b[0;1;34m",  // Blue
+    "\x1b[0;1;32m",  // Green
+    "\x1b[0;1;35m",  // Magenta
+    "\x1b[0;1;36m",  // Cyan
+    "\x1b[0;1;91m",  // Bright red
+};
+const int NUM_TERM_PLAYER_COLORS = (int)(sizeof(PALETTE) / sizeof(PALETTE[0])) - COLOR_PLAYER;
+
+const int DEFAULT_COLUMNS = 80;
+const int DEFAULT_ROWS = 24;
+const size_t STATUS_SCORES = 5;
+const int MAX_BRIDGED_BLANKS = 4;  // A cursor move costs about 8 bytes
+
+}
+
+TerminalRenderer::TerminalRenderer(int fd) :
+    fd(fd), columns(0), rows(0), followed(0), drawnVersion(0), drawnItems(0), drawnGameOver(false),
+    started(false), fullRedraw(true), written(0) {}
+
+TerminalRenderer::~TerminalRenderer() {
+    close();
+}
+
+void TerminalRenderer::resize(int new_columns, int new_rows) {
+    columns = new_columns;
+    rows = new_rows;
+    Cell blank = {' ', COLOR_DEFAULT};
+    front.assign((size_t)columns * rows, blank);
+    back.assign((size_t)columns * rows, blank);
+    fullRedraw = true;
+}
+
+bool TerminalRenderer::draw(const GameSnapshot& snapshot, bool gameOver) {
+    struct winsize ws;
+    int new_columns = DEFAULT_COLUMNS;
+    int new_rows = DEFAULT_ROWS;
+    if (ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+        new_columns = ws.ws_col;
+        new_rows = ws.ws_row;
+    }
+    if (new_columns != columns || new_rows != rows) {
+        resize(new_columns, new_rows);
+    }
+    if (!fullRedraw && snapshot.version == drawnVersion && snapshot.items_version == drawnItems &&
+        gameOver == drawnGameOver) {
+        return false;
+    }
+
+    out.clear();
+    if (!started) {
+        out += "\x1b[?25l";  // Hide the cursor while the game runs
+        started = true;
+    }
+    fill(snapshot, gameOver);
+    emitChanges();
+    drawnVersion = snapshot.version;
+    drawnItems = snapshot.items_version;
+    drawnGameOver = gameOver;
+    return flush();
+}
+
+void TerminalRenderer::putText(int row, const string& text, uint8_t color) {
+    Cell* line = &back[(size_t)row * columns];
+    int length = min((int)text.size(), columns);
+    for (int c = 0; c < length; ++c) {
+        line[c].ch = text[c];
+        line[c].color = color;
+    }
+}
+
+void TerminalRenderer::fill(const GameSnapshot& snapshot, bool gameOver) {
+    Cell blank = {' ', COLOR_DEFAULT};
+    std::fill(back.begin(), back.end(), blank);
+
+    // Row 0 is the status line and the last row stays empty, so writing
+    // the bottom right cell never scrolls the screen. Every board cell is
+    // two columns wide to keep it roughly square. The snapshot only has the
+    // items inside its own view, so the viewport stays within that.
+    int board = snapshot.board_size;
+    int view_w = min(snapshot.view_size, columns / 2);
+    int view_h = min(snapshot.view_size, rows - 2);
+    int left = snapshot.view_x;
+    int top = snapshot.view_y;
+    if (followed >= 0 && followed < (int)snapshot.players.size()) {
+        const Player& player = snapshot.players[followed];
+        left = max(snapshot.view_x, min(player.x - view_w / 2, snapshot.view_x + snapshot.view_size - view_w));
+        top = max(snapshot.view_y, min(player.y - view_h / 2, snapshot.view_y + snapshot.view_size - view_h));
+    }
+
+    if (view_w > 0 && view_h > 0) {
+        for (int y = 0; y < view_h; ++y) {
+            Cell* line = &back[(size_t)(y + 1) * columns];
+            for (int x = 0; x < view_w; ++x) {
+                line[2 * x].ch = '.';
+                line[2 * x].color = COLOR_FLOOR;
+            }
+        }
+        for (const auto& item : snapshot.items) {
+            int x = item.first - left;
+            int y = item.second - top;
+            if (x >= 0 && x < view_w && y >= 0 && y < view_h) {
+                Cell& cell = back[(size_t)(y + 1) * columns + 2 * x];
+                cell.ch = '*';
+                cell.color = COLOR_ITEM;
+            }
+        }
+        for (size_t i = 0; i < snapshot.players.size(); ++i) {
+            int x = snapshot.players[i].x - left;
+            int y = snapshot.players[i].y - top;
+            if (x >= 0 && x < view_w && y >= 0 && y < view_h) {
+                Cell& cell = back[(size_t)(y + 1) * columns + 2 * x];
+                cell.ch = snapshot.players[i].symbol;
+                cell.color = (uint8_t)(COLOR_PLAYER + i % NUM_TERM_PLAYER_COLORS);
+            }
+        }
+    }
+
+    vector<int> leaders = leadingPlayers(snapshot.players, STATUS_SCORES);
+    char text[64];
+    string status;
+    if (gameOver && !leaders.empty()) {
+        snprintf(text, sizeof(text), " GAME OVER - player %d wins with %d ",
+                 leaders[0] + 1, snapshot.players[leaders[0]].score);
+        putText(0, text, COLOR_BANNER);
+        return;
+    }
+    snprintf(text, sizeof(text), "Items left: %d  ", max(0, snapshot.items_remaining));
+    status = text;
+    for (int id : leaders) {
+        snprintf(text, sizeof(text), " %d:%d", id + 1, snapshot.players[id].score);
+        status += text;
+    }
+    if (view_w < board || view_h < board) {
+        snprintf(text, sizeof(text), "   view %d,%d of %dx%d", left, top, board, board);
+        status += text;
+    }
+    putText(0, status, COLOR_STATUS);
+}
+
+void TerminalRenderer::emitChanges() {
+    if (fullRedraw) {
+        out += "\x1b[0m\x1b[2J";
+        Cell blank = {' ', COLOR_DEFAULT};
+        std::fill(front.begin(), front.end(), blank);
+        fullRedraw = false;
+    }
+
+    // The cursor only needs moving when the next changed cell isn't the
+    // one right after the last cell written. Short runs of unchanged
+    // blanks in between are cheaper to overwrite than to jump over.
+    int cursor_row = -1;
+    int cursor_col = -1;
+    int color = -1;
+    char move[32];
+    for (size_t i = 0; i < back.size(); ++i) {
+        if (!(back[i] != front[i])) {
+            continue;
+        }
+        int row = (int)(i / columns);
+        int col = (int)(i % columns);
+        if (row == cursor_row && col > cursor_col && col - cursor_col <= MAX_BRIDGED_BLANKS &&
+            color != COLOR_BANNER) {
+            size_t gap = i - (size_t)(col - cursor_col);
+            while (gap < i && front[gap].ch == ' ' && front[gap].color != COLOR_BANNER) {
+                gap++;
+            }
+            if (gap == i) {
+                out.append((size_t)(col - cursor_col), ' ');
+                cursor_col = col;
+            }
+        }
+        if (row != cursor_row || col != cursor_col) {
+            snprintf(move, sizeof(move), "\x1b[%d;%dH", row + 1, col + 1);
+            out += move;
+            cursor_row = row;
+        }
+        if (back[i].color != color) {
+            color = back[i].color;
+            out += PALETTE[color];
+        }
+        out += back[i].ch;
+        cursor_col = col + 1;
+        front[i] = back[i];
+    }
+}
+
+bool TerminalRenderer::flush() {
+    const char* data = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t n = write(fd, data, left);
+        if (n > 0) {
+            data += n;
+            left -= (size_t)n;
+            written += (uint64_t)n;
+        } else if (n < 0 && errno == EAGAIN) {
+            pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, 100);
+        } else if (!(n < 0 && errno == EINTR)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TerminalRenderer::close() {
+    if (!started) {
+        return;
+    }
+    out.clear();
+    char move[32];
+    snprintf(move, sizeof(move), "\x1b[%d;1H", rows);
+    out += "\x1b[0m";
+    out += move;
+    out += "\x1b[?25h\n";
+    flush();
+    started = false;
+}
+
+TerminalInput::TerminalInput() : raw(false) {
+    memset(&saved, 0, sizeof(saved));
+}
+
+TerminalInput::~TerminalInput() {
+    close();
+}
+
+bool TerminalInput::open() {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved) != 0) {
+        return false;
+    }
+    // No line buffering or echo; Ctrl-C still raises SIGINT
+    struct termios settings = saved;
+    settings.c_lflag &= ~(ICANON | ECHO);
+    settings.c_cc[VMIN] = 0;
+    settings.c_cc[VTIME] = 0;
+    raw = tcsetattr(STDIN_FILENO, TCSANOW, &settings) == 0;
+    return raw;
+}
+
+void TerminalInput::close() {
+    if (raw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+        raw = false;
+    }
+}
+
+bool TerminalInput::readMoves(int timeout_ms, vector<pair<int, int> >& moves) {
+    if (!raw) {
+        poll(nullptr, 0, timeout_ms);
+        return true;
+    }
+    pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return true;
+    }
+    char buf[256];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n == 0) {
+        return false;
+    }
+    if (n < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    pending.append(buf, (size_t)n);
+
+    size_t i = 0;
+    while (i < pending.size()) {
+        char c = pending[i];
+        if (c == '\x1b') {
+            // Arrow keys arrive as ESC [ A..D (or ESC O A..D)
+            if (i + 2 >= pending.size()) {
+                break;
+            }
+            if (pending[i + 1] != '[' && pending[i + 1] != 'O') {
+                i++;
+                continue;
+            }
+            const char* arrows = "ABDC";  // Up, down, left, right
+            const char* arrow = strchr(arrows, pending[i + 2]);
+            if (arrow && *arrow) {
+                moves.push_back(make_pair(1, (int)(arrow - arrows)));
+            }
+            i += 3;
+            continue;
+        }
+        const char* wasd = "wsad";
+        const char* key = strchr(wasd, tolower((unsigned char)c));
+        if (key && *key) {
+            moves.push_back(make_pair(0, (int)(key - wasd)));
+        } else if (c == 'q' || c == 'Q') {
+            return false;
+        }
+        i++;
+    }
+    pending.erase(0, i);
+    return true;
+}
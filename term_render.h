@@ -0,0 +1,90 @@
+#ifndef TERM_RENDER_H
+#define TERM_RENDER_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <termios.h>
+#include "snapshot.h"
+
+// Text front end for terminals (--renderer term), e.g. over SSH.
+//
+// Each frame is drawn into a flat buffer of terminal cells that lives
+// as long as the renderer. Only the cells that differ from the previous
+// frame are sent, as ANSI cursor moves and color changes, in a single
+// write(). Boards bigger than the terminal are shown through a viewport
+// that follows one player.
+class TerminalRenderer {
+public:
+    explicit TerminalRenderer(int fd = 1);
+    ~TerminalRenderer();
+
+    // Player the viewport stays centered on
+    void follow(int player_id) { followed = player_id; }
+
+    // Draw the board as of snapshot, with the game over banner once
+    // gameOver is set. Returns false if the frame was skipped because
+    // nothing changed.
+    bool draw(const GameSnapshot& snapshot, bool gameOver);
+
+    // Put the cursor and colors back, below the board
+    void close();
+
+    uint64_t bytesWritten() const { return written; }
+
+private:
+    TerminalRenderer(const TerminalRenderer&);
+    TerminalRenderer& operator=(const TerminalRenderer&);
+
+    struct Cell {
+        char ch;
+        uint8_t color;  // Index into the palette in term_render.cpp
+
+        bool operator!=(const Cell& other) const { return ch != other.ch || color != other.color; }
+    };
+
+    void resize(int columns, int rows);
+    void fill(const GameSnapshot& snapshot, bool gameOver);
+    void putText(int row, const std::string& text, uint8_t color);
+    void emitChanges();
+    bool flush();
+
+    int fd;
+    int columns;
+    int rows;
+    std::vector<Cell> front;   // What the terminal shows
+    std::vector<Cell> back;    // The frame being drawn
+    std::string out;           // Escape sequences for one frame
+    int followed;
+    unsigned long drawnVersion;
+    unsigned long drawnItems;  // items_version of the frame on screen
+    bool drawnGameOver;
+    bool started;
+    bool fullRedraw;
+    uint64_t written;
+};
+
+// Keyboard input from a terminal in raw mode. Holding a key relies on
+// the terminal's own auto-repeat, since terminals don't report key ups.
+class TerminalInput {
+public:
+    TerminalInput();
+    ~TerminalInput();
+
+    // Switch stdin to raw mode; false (and no input) if it isn't a terminal
+    bool open();
+    void close();
+
+    // Wait up to timeout_ms for keys and append the moves they make as
+    // (key map, direction): WASD is key map 0, the arrow keys are 1.
+    // Returns false once q is pressed or stdin is closed.
+    bool readMoves(int timeout_ms, std::vector<std::pair<int, int> >& moves);
+
+private:
+    bool raw;
+    std::string pending;  // Start of an escape sequence split across reads
+    struct termios saved; // Terminal settings to restore
+};
+
+#endif // TERM_RENDER_H
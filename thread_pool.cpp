@@ -0,0 +1,157 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include "trace.h"
+
+namespace {
+// Which pool and worker the current thread belongs to
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_index = -1;
+}
+
+ThreadPool::ThreadPool(size_t num_threads) : queued(0), next_worker(0), stopping(false) {
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+}
+
+void WaitGroup::add(size_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += count;
+}
+
+void WaitGroup::done() {
+    // Notified under the lock, so a waiter can't return and destroy the
+    // group while this is still using it
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0) {
+        idle.notify_all();
+    }
+}
+
+void WaitGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return pending == 0; });
+}
+
+namespace {
+// Indices of a parallelFor, handed out first come first served. Shared
+// with the tasks, since one may only start after the loop has returned.
+struct ParallelFor {
+    std::atomic<size_t> next;
+    size_t count;
+    const std::function<void(size_t)>* body;  // Only used while indices are left
+    WaitGroup finished;
+
+    void run() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            (*body)(i);
+            finished.done();
+        }
+    }
+};
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    std::shared_ptr<ParallelFor> loop = std::make_shared<ParallelFor>();
+    loop->next = 0;
+    loop->count = count;
+    loop->body = &body;
+    loop->finished.add(count);
+    for (size_t t = 0; t < std::min(count - 1, workers.size()); ++t) {
+        submit([loop]() { loop->run(); });
+    }
+    loop->run();
+    loop->finished.wait();
+}
+
+int ThreadPool::currentWorker() {
+    return current_index;
+}
+
+void ThreadPool::submit(Task task) {
+    // Tasks spawned by our own workers stay local; everything else is
+    // dealt out round-robin
+    size_t index;
+    if (current_pool == this) {
+        index = (size_t)current_index;
+    } else {
+        index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    queued.fetch_add(1, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    wake.notify_one();
+}
+
+bool ThreadPool::popLocal(size_t index, Task& task) {
+    Worker& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief, Task& task) {
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(thief + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    current_pool = this;
+    current_index = (int)index;
+    TRACE_THREAD("worker");
+
+    for (;;) {
+        Task task;
+        if (popLocal(index, task) || steal(index, task)) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]() {
+            return stopping || queued.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping && queued.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts work in flight: add() before handing work out, done() as each
+// piece finishes. wait() sleeps until the count is back to zero, and the
+// group may be destroyed as soon as it returns.
+class WaitGroup {
+public:
+    WaitGroup() : pending(0) {}
+
+    void add(size_t count = 1);
+    void done();
+    void wait();
+
+private:
+    WaitGroup(const WaitGroup&);
+    WaitGroup& operator=(const WaitGroup&);
+
+    size_t pending;
+    std::mutex mutex;
+    std::condition_variable idle;
+};
+
+// Fixed-size work-stealing thread pool.
+//
+// Every worker owns a deque of tasks. A worker pops its own newest task
+// first (cache-warm LIFO order) and, when it runs dry, steals the oldest
+// task from another worker. Tasks submitted from outside the pool are
+// spread round-robin over the workers. Idle workers sleep on a condition
+// variable, so an idle pool uses no CPU.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(size_t num_threads);
+    ~ThreadPool();
+
+    size_t size() const { return workers.size(); }
+
+    // Queue a task. Safe to call from any thread, including from a task.
+    void submit(Task task);
+
+    // Call body(i) for every i in [0, count), in any order and on any
+    // thread, and return once every call is done. The calling thread takes
+    // indices alongside the workers rather than waiting idle, so this is
+    // safe from a task too: with every worker busy, the caller does it all.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Index of the pool worker running the calling thread, or -1 when
+    // called from a thread that doesn't belong to a pool
+    static int currentWorker();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, Task& task);
+    bool steal(size_t thief, Task& task);
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<std::thread> threads;
+
+    // Number of tasks sitting in worker deques; workers sleep while it is 0
+    std::atomic<size_t> queued;
+    std::atomic<size_t> next_worker;
+    std::atomic<bool> stopping;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,164 @@
+#include "timer_wheel.h"
+
+#include <cassert>
+
+using namespace std;
+
+TimerWheel::TimerWheel() : next(0), live(0), journal(nullptr) {
+    for (int l = 0; l < LEVELS; ++l) {
+        occupied[l] = 0;
+    }
+}
+
+Timer TimerWheel::timerOf(const Entry& entry) const {
+    Timer timer = {idOf(entry.node), entry.deadline, entry.kind, entry.arg};
+    return timer;
+}
+
+int32_t TimerWheel::allocate() {
+    int32_t n;
+    if (free_nodes.empty()) {
+        n = (int32_t)nodes.size();
+        Node node = {0, -1, 0};
+        nodes.push_back(node);
+    } else {
+        n = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    nodes[n].generation++;
+    return n;
+}
+
+void TimerWheel::release(int32_t n) {
+    nodes[n].slot = -1;
+    free_nodes.push_back(n);
+}
+
+// Put a timer in the slot for its deadline, seen from next: the level is
+// the highest 6-bit group in which the two differ, so the slot comes up
+// (or is spread into a lower level) no later than the deadline
+void TimerWheel::place(const Entry& entry) {
+    uint32_t deadline = entry.deadline < next ? next : entry.deadline;
+    uint32_t diff = deadline ^ next;
+    int level = diff < (uint32_t)SLOTS ? 0 : (31 - __builtin_clz(diff)) / SLOT_BITS;
+    int bucket = (deadline >> (level * SLOT_BITS)) & (SLOTS - 1);
+    int slot = level * SLOTS + bucket;
+    Node& node = nodes[entry.node];
+    node.slot = slot;
+    node.pos = (uint32_t)slots[slot].size();
+    slots[slot].push_back(entry);
+    occupied[level] |= 1ULL << bucket;
+}
+
+// Take node n's timer out of its slot, filling the gap with the last one
+TimerWheel::Entry TimerWheel::remove(int32_t n) {
+    const Node& node = nodes[n];
+    vector<Entry>& slot = slots[node.slot];
+    Entry entry = slot[node.pos];
+    slot[node.pos] = slot.back();
+    nodes[slot[node.pos].node].pos = node.pos;
+    slot.pop_back();
+    if (slot.empty()) {
+        occupied[node.slot / SLOTS] &= ~(1ULL << (node.slot % SLOTS));
+    }
+    return entry;
+}
+
+// Move a slot's timers into taken, leaving the slot empty
+void TimerWheel::takeSlot(int slot) {
+    taken.clear();
+    taken.swap(slots[slot]);
+    occupied[slot / SLOTS] &= ~(1ULL << (slot % SLOTS));
+}
+
+TimerId TimerWheel::schedule(uint32_t deadline, uint32_t kind, uint32_t arg) {
+    Entry entry = {deadline < next ? next : deadline, kind, arg, allocate()};
+    place(entry);
+    live++;
+    if (journal) {
+        TimerOp op = {timerOf(entry), true};
+        journal->push_back(op);
+    }
+    return idOf(entry.node);
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    int32_t n = (int32_t)(uint32_t)id;
+    if (id == NO_TIMER || n >= (int32_t)nodes.size() || nodes[n].slot == -1 ||
+        nodes[n].generation != (uint32_t)(id >> 32)) {
+        return false;
+    }
+    Entry entry = remove(n);
+    if (journal) {
+        TimerOp op = {timerOf(entry), false};
+        journal->push_back(op);
+    }
+    release(n);
+    live--;
+    return true;
+}
+
+void TimerWheel::expire(uint32_t tick, vector<Timer>& due) {
+    if (tick < next) {
+        return;
+    }
+    if (live == 0) {
+        next = tick + 1;
+        return;
+    }
+    for (;;) {
+        // Spread the slots whose span starts at this tick into the levels
+        // below, highest first
+        int top = 0;
+        while (top + 1 < LEVELS && (next & ((1u << ((top + 1) * SLOT_BITS)) - 1)) == 0) {
+            top++;
+        }
+        for (int level = top; level > 0; --level) {
+            int bucket = (next >> (level * SLOT_BITS)) & (SLOTS - 1);
+            if (occupied[level] & (1ULL << bucket)) {
+                takeSlot(level * SLOTS + bucket);
+                for (const auto& entry : taken) {
+                    place(entry);
+                }
+            }
+        }
+
+        int bucket = next & (SLOTS - 1);
+        if (occupied[0] & (1ULL << bucket)) {
+            takeSlot(bucket);
+            for (const auto& entry : taken) {
+                if (entry.deadline <= next) {
+                    due.push_back(timerOf(entry));
+                    if (journal) {
+                        TimerOp op = {due.back(), false};
+                        journal->push_back(op);
+                    }
+                    release(entry.node);
+                    live--;
+                } else {
+                    place(entry);  // Came up early after a rewind
+                }
+            }
+        }
+        if (next++ == tick) {
+            break;
+        }
+    }
+}
+
+void TimerWheel::undo(const TimerOp& op) {
+    int32_t n = (int32_t)(uint32_t)op.timer.id;
+    if (op.added) {
+        remove(n);
+        release(n);
+        nodes[n].generation--;
+        live--;
+        return;
+    }
+    // Undone in reverse, so the node is the last one freed
+    assert(!free_nodes.empty() && free_nodes.back() == n);
+    free_nodes.pop_back();
+    Entry entry = {op.timer.deadline, op.timer.kind, op.timer.arg, n};
+    place(entry);
+    live++;
+}
@@ -0,0 +1,99 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Timers on the simulation tick, kept in a hierarchical timing wheel: six
+// levels of 64 slots, level L holding timers that are due within 64^(L+1)
+// ticks. Scheduling and cancelling are O(1) whatever the number of timers.
+// Each tick, expire() takes the due timers out of one level 0 slot as a
+// batch; when the low bits of the tick roll over, the matching slot of
+// the level above is spread into the levels below first. A timer is moved
+// at most once per level on its way down.
+//
+// Timer ids carry a generation, so cancelling a timer that already fired
+// (or was cancelled) is a harmless no-op even if its slot is reused.
+typedef uint64_t TimerId;
+const TimerId NO_TIMER = ~0ULL;
+
+struct Timer {
+    TimerId id;
+    uint32_t deadline;   // The tick it fires in
+    uint32_t kind;       // What to do, and who to do it to; up to the owner
+    uint32_t arg;
+};
+
+// One change to the wheel, for undoing it; see setJournal
+struct TimerOp {
+    Timer timer;
+    bool added;          // Scheduled, or else fired or cancelled
+};
+
+class TimerWheel {
+public:
+    TimerWheel();
+
+    // The next tick expire() will handle; every earlier tick is done
+    uint32_t time() const { return next; }
+
+    // Timers waiting to fire
+    size_t size() const { return live; }
+
+    // Fire kind/arg in tick deadline, or in time() if that has passed
+    TimerId schedule(uint32_t deadline, uint32_t kind, uint32_t arg);
+
+    // Returns false if the timer already fired or was cancelled
+    bool cancel(TimerId id);
+
+    // Handle every tick from time() up to and including tick, appending
+    // the timers due in them to due, tick by tick
+    void expire(uint32_t tick, std::vector<Timer>& due);
+
+    // While set, every schedule, cancel and fired timer is appended to
+    // journal. To go back to tick t, rewind(t) and then pass the ops made
+    // since to undo(), newest first. Null to stop.
+    void setJournal(std::vector<TimerOp>* out) { journal = out; }
+    void rewind(uint32_t tick) { next = tick; }
+    void undo(const TimerOp& op);
+
+private:
+    static const int LEVELS = 6;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    // Slots are arrays rather than linked lists, so firing and spreading
+    // a slot reads its timers front to back; a node only remembers where
+    // its timer is, for cancel()
+    struct Entry {
+        uint32_t deadline;
+        uint32_t kind;
+        uint32_t arg;
+        int32_t node;
+    };
+    struct Node {
+        uint32_t generation;
+        int32_t slot;    // Index into slots, or -1 while free
+        uint32_t pos;    // Index in the slot
+    };
+
+    TimerId idOf(int32_t n) const { return ((uint64_t)nodes[n].generation << 32) | (uint32_t)n; }
+    Timer timerOf(const Entry& entry) const;
+    int32_t allocate();
+    void release(int32_t n);
+    void place(const Entry& entry);
+    Entry remove(int32_t n);
+    void takeSlot(int slot);
+
+    std::vector<Node> nodes;
+    std::vector<int32_t> free_nodes;  // A stack, so undo finds a freed node on top
+    std::vector<Entry> slots[LEVELS * SLOTS];
+    uint64_t occupied[LEVELS];        // Bit s set when slot s of the level has timers
+    std::vector<Entry> taken;         // The slot being fired or spread
+    uint32_t next;
+    size_t live;
+    std::vector<TimerOp>* journal;
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> traceActive(false);
+
+namespace {
+
+struct TraceEvent {
+    atomic<const char*> name;
+    atomic<uint64_t> start_ns;
+    atomic<uint64_t> end_ns;
+};
+
+// One thread's zones. The owner claims a slot, writes it and commits it;
+// a reader copies committed slots and then drops any whose slot was
+// claimed again while it was copying, so it never needs a lock.
+struct TraceRing {
+    atomic<const char*> thread_name;
+    atomic<uint64_t> claimed;
+    atomic<uint64_t> committed;
+    TraceEvent events[TRACE_RING_SIZE];
+
+    TraceRing() : thread_name(nullptr), claimed(0), committed(0) {}
+};
+
+struct Zone {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// Never freed: a thread's zones outlive it until the next export
+mutex rings_mutex;
+vector<TraceRing*> rings;
+
+thread_local TraceRing* thread_ring = nullptr;
+thread_local const char* thread_name = nullptr;
+
+TraceRing* registerThread() {
+    TraceRing* ring = new TraceRing();
+    ring->thread_name.store(thread_name, memory_order_relaxed);
+    lock_guard<mutex> lock(rings_mutex);
+    rings.push_back(ring);
+    return ring;
+}
+
+void copyZones(TraceRing& ring, vector<Zone>& out) {
+    uint64_t end = ring.committed.load(memory_order_acquire);
+    uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    size_t first = out.size();
+    for (uint64_t i = begin; i < end; ++i) {
+        const TraceEvent& event = ring.events[i % TRACE_RING_SIZE];
+        Zone zone = {event.name.load(memory_order_relaxed),
+                     event.start_ns.load(memory_order_relaxed),
+                     event.end_ns.load(memory_order_relaxed)};
+        out.push_back(zone);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t claimed = ring.claimed.load(memory_order_relaxed);
+    // Slot i was claimed again once claimed passed i + TRACE_RING_SIZE
+    uint64_t valid = claimed > TRACE_RING_SIZE ? claimed - TRACE_RING_SIZE : 0;
+    if (valid > begin) {
+        size_t overwritten = (size_t)min(valid - begin, end - begin);
+        out.erase(out.begin() + first, out.begin() + first + overwritten);
+    }
+}
+
+void writeName(FILE* out, const char* name) {
+    fputc('"', out);
+    for (const char* p = name; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+}
+
+void startTracing() {
+    traceActive.store(true, memory_order_relaxed);
+}
+
+void stopTracing() {
+    traceActive.store(false, memory_order_relaxed);
+}
+
+void setTraceThreadName(const char* name) {
+    thread_name = name;
+    if (thread_ring) {
+        thread_ring->thread_name.store(name, memory_order_relaxed);
+    }
+}
+
+void recordTraceZone(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    if (!thread_ring) {
+        thread_ring = registerThread();
+    }
+    TraceRing& ring = *thread_ring;
+    uint64_t n = ring.committed.load(memory_order_relaxed);
+    ring.claimed.store(n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    TraceEvent& event = ring.events[n % TRACE_RING_SIZE];
+    event.name.store(name, memory_order_relaxed);
+    event.start_ns.store(start_ns, memory_order_relaxed);
+    event.end_ns.store(end_ns, memory_order_relaxed);
+    ring.committed.store(n + 1, memory_order_release);
+}
+
+bool writeTrace(const string& path) {
+    vector<TraceRing*> threads;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        threads = rings;
+    }
+    vector<vector<Zone> > zones(threads.size());
+    uint64_t origin = ~0ULL;
+    for (size_t t = 0; t < threads.size(); ++t) {
+        copyZones(*threads[t], zones[t]);
+        for (const auto& zone : zones[t]) {
+            origin = min(origin, zone.start_ns);
+        }
+    }
+
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    // Timestamps are microseconds from the earliest zone
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for (size_t t = 0; t < threads.size(); ++t) {
+        const char* name = threads[t]->thread_name.load(memory_order_relaxed);
+        fprintf(out, "%s{\"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"name\": \"thread_name\", \"args\": {\"name\": ",
+                first ? "" : ",\n", t + 1);
+        if (name) {
+            writeName(out, name);
+        } else {
+            fprintf(out, "\"thread %zu\"", t + 1);
+        }
+        fprintf(out, "}}");
+        first = false;
+        for (const auto& zone : zones[t]) {
+            fprintf(out, ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f, \"name\": ",
+                    t + 1, (zone.start_ns - origin) / 1000.0, (zone.end_ns - zone.start_ns) / 1000.0);
+            writeName(out, zone.name);
+            fputc('}', out);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+}
@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "metrics.h"
+
+// Scoped trace zones, exported as Chrome trace event JSON (load the file
+// in chrome://tracing or ui.perfetto.dev).
+//
+//   void renderFrame() {
+//       TRACE_ZONE("render");
+//       ...
+//   }
+//
+// A zone records its name, start and end into the calling thread's own
+// ring of the last TRACE_RING_SIZE zones when it closes; no lock is taken
+// and nothing is allocated. Rings keep recording over their oldest zones,
+// so writeTrace() always has the most recent few seconds of every thread.
+// Zone names must be string literals (or otherwise live forever).
+//
+// While tracing is stopped a zone costs one relaxed load; built with
+// TRACE_ENABLED=0 (make TRACE=0) zones compile to nothing.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+const size_t TRACE_RING_SIZE = 1 << 14;   // Zones kept per thread, 24 bytes each
+
+extern std::atomic<bool> traceActive;
+
+void startTracing();
+void stopTracing();
+
+// Name the calling thread in exported traces
+void setTraceThreadName(const char* name);
+
+// Write every thread's recorded zones to path; safe to call while other
+// threads keep recording
+bool writeTrace(const std::string& path);
+
+// Append a zone to this thread's ring; use TRACE_ZONE instead
+void recordTraceZone(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+class TraceZone {
+public:
+    explicit TraceZone(const char* name) :
+        name(name), start_ns(traceActive.load(std::memory_order_relaxed) ? nowNs() : 0) {}
+
+    ~TraceZone() {
+        if (start_ns) {
+            recordTraceZone(name, start_ns, nowNs());
+        }
+    }
+
+private:
+    TraceZone(const TraceZone&);
+    TraceZone& operator=(const TraceZone&);
+
+    const char* name;
+    uint64_t start_ns;
+};
+
+#if TRACE_ENABLED
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD(name) setTraceThreadName(name)
+#else
+#define TRACE_ZONE(name) do {} while (0)
+#define TRACE_THREAD(name) do {} while (0)
+#endif
+
+#endif // TRACE_H